@@ -19,8 +19,12 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 
 #include "alpha4/common/logger.hpp"
 #include "core/animation_api.h"
+#include "core/egress.hpp"
+#include "core/frame.hpp"
 #include "core/frame_api.h"
 #include "util/module.hpp"
+#include <cctype>
+#include <cmath>
 #include <cstring>
 #include <functional>
 #include <memory>
@@ -31,6 +35,34 @@ static std::unordered_map<animno_t, std::shared_ptr<Animation>> _AnimationMap;
 static animno_t _AnimationCount = 0;
 static animno_t AllocateAnimationNumber() { return ++_AnimationCount; }
 
+// frame-sized scratch buffers for anim_render_to, one per nesting level
+static thread_local std::vector<std::vector<led_t>> _RenderScratch;
+static thread_local size_t                          _RenderDepth = 0;
+
+// runs render with frame_raw_anim() redirected to a frame-sized scratch
+// buffer, then gathers the LEDs at ledv into the dense buffer dst
+template <typename Render>
+static void
+_RenderDense(const led_i_t *ledv, size_t ledn, led_t *dst, Render render) {
+	const size_t depth = _RenderDepth;
+	if (_RenderScratch.size() <= depth) _RenderScratch.emplace_back();
+	if (_RenderScratch[depth].size() < frame_size()) {
+		_RenderScratch[depth].resize(frame_size(), {0, 0, 0});
+	}
+
+	led_t *prev = Frame::RedirectAnim(_RenderScratch[depth].data());
+	_RenderDepth++;
+	render();
+	_RenderDepth--;
+	Frame::RedirectAnim(prev);
+
+	// nested renders may have grown the outer vector, so index again
+	const led_t *scratch = _RenderScratch[depth].data();
+	for (size_t i = 0; i < ledn; i++) {
+		dst[i] = scratch[ledv[i]];
+	}
+}
+
 void Animation::LEDsRemoved(led_i_t offset, led_i_t count) {
 	for (auto it : _AnimationMap) {
 		it.second->_leds.adjustRemovedLEDs(offset, count);
@@ -45,6 +77,14 @@ Animation::Animation(const std::string &ident, basemodno_t basemodno) :
 		basemodule_resolve(_basemodno, "deinit"));
 	_iterate = reinterpret_cast<animation_iterate_t>(
 		basemodule_resolve(_basemodno, "iterate"));
+	if (auto flags = reinterpret_cast<const unsigned *>(
+				basemodule_resolve(_basemodno, "Flags"))) {
+		_flags = *flags;
+	}
+	if (auto rate = reinterpret_cast<const float *>(
+				basemodule_resolve(_basemodno, "Rate"))) {
+		_rate = *rate;
+	}
 
 	if (!_iterate) {
 		alp::thrower<AnimationInitError>()
@@ -71,7 +111,25 @@ Animation::Animation(
 	_iterate(iterate),
 	_userdata(userdata) {}
 
+Animation::Animation(
+	std::shared_ptr<Animation> source, const led_i_t *ledv, size_t ledn) :
+	_animno(AllocateAnimationNumber()),
+	_ident(source->_ident),
+	_init(nullptr),
+	_deinit(nullptr),
+	_iterate(source->_iterate),
+	_usageCount(1),
+	_initialized(true),
+	_flags(source->_flags),
+	_argstring(source->_argstring),
+	_source(source),
+	_rate(source->_rate) {
+	_leds.append(ledv, ledn);
+	_source->_shareCount++;
+}
+
 Animation::~Animation() {
+	if (_source) _source->_shareCount--;
 	if (_deinit) { _deinit(_userdata); }
 	basemodule_drop(_basemodno);
 }
@@ -90,6 +148,7 @@ void Animation::initialize(const std::string &argstring) {
 			<< "attempted to initialize animation twice" << alp::over;
 	}
 	_initialized = true;
+	_argstring   = argstring;
 
 	_usageCount++;
 	if (_init) {
@@ -102,26 +161,156 @@ void Animation::initialize(const std::string &argstring) {
 	}
 }
 
-void Animation::doIterate(frame_time_t dt, frame_time_t t) const {
-	_iterate(_leds.data(), _leds.size(), _userdata, dt, t);
+void Animation::doIterate(frame_time_t dt, frame_time_t t) {
+	render(_leds.data(), _leds.size(), dt, t);
+}
+
+void Animation::render(
+	const led_i_t *ledv, size_t ledn, frame_time_t dt, frame_time_t t) {
+	if (_source) {
+		_source->render(ledv, ledn, dt, t);
+		return;
+	}
+	if (!(_rate > 0) || ledn < 1) {
+		_iterate(ledv, ledn, _userdata, dt, t);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_keyframeMutex);
+	Keyframes &                 kf = _keyframes;
+
+	// LED indices shift when egress instances come and go
+	const size_t size = frame_size();
+	if (kf.k0.size() != size) {
+		kf.k0.assign(size, {0, 0, 0});
+		kf.k1.assign(size, {0, 0, 0});
+		kf.have0.resize(size);
+		kf.have1.resize(size);
+		kf.valid = false;
+	}
+
+	// impure animations may depend on the position of LEDs in ledv, so their
+	// keyframes are only valid for the exact list they were rendered for
+	const bool pure = _flags & ANIMATION_PURE;
+	if (
+		!pure
+		&& (kf.leds.size() != ledn
+				|| std::memcmp(kf.leds.data(), ledv, ledn * sizeof(led_i_t)) != 0)) {
+		kf.leds.assign(ledv, ledv + ledn);
+		kf.valid = false;
+	}
+
+	const frame_time_t period = 1 / (frame_time_t)_rate;
+	const frame_time_t phase  = t * _rate;
+	const long         index  = (long)std::floor(phase);
+
+	bool restart = false;
+	if (!kf.valid || index != kf.index) {
+		if (kf.valid && index == kf.index + 1) {
+			std::swap(kf.k0, kf.k1);
+			std::swap(kf.have0, kf.have1);
+		} else {
+			std::fill(kf.have0.begin(), kf.have0.end(), 0);
+			restart = true;
+		}
+		std::fill(kf.have1.begin(), kf.have1.end(), 0);
+		kf.index = index;
+		kf.valid = true;
+	}
+
+	// iterates the LEDs of ledv not yet present in a keyframe straight into it.
+	// For impure animations, these are either none or all of ledv.
+	auto renderKey = [&](bool next, frame_time_t kdt) {
+		std::vector<led_t> &dst  = next ? kf.k1 : kf.k0;
+		std::vector<char> & have = next ? kf.have1 : kf.have0;
+		kf.missing.clear();
+		for (size_t i = 0; i < ledn; i++) {
+			if (have[ledv[i]]) continue;
+			have[ledv[i]] = 1;
+			kf.missing.push_back(ledv[i]);
+		}
+		if (kf.missing.empty()) return;
+		led_t *prev = Frame::RedirectAnim(dst.data());
+		_iterate(
+			kf.missing.data(),
+			kf.missing.size(),
+			_userdata,
+			kdt,
+			(index + next) * period);
+		Frame::RedirectAnim(prev);
+	};
+	if (restart && !pure) {
+		// iterating both keyframes would advance stateful animations twice in
+		// one frame, so the first period is held at the next keyframe instead
+		renderKey(true, dt);
+		for (size_t i = 0; i < ledn; i++) {
+			kf.k0[ledv[i]]    = kf.k1[ledv[i]];
+			kf.have0[ledv[i]] = 1;
+		}
+	}
+	renderKey(false, dt);
+	renderKey(true, period);
+
+	const float f   = (float)(phase - index);
+	led_t *     raw = frame_raw_anim();
+	for (size_t i = 0; i < ledn; i++) {
+		const led_t &k0 = kf.k0[ledv[i]], &k1 = kf.k1[ledv[i]];
+		raw[ledv[i]]    = {
+			k0.r + (k1.r - k0.r) * f,
+			k0.g + (k1.g - k0.g) * f,
+			k0.b + (k1.b - k0.b) * f};
+	}
 }
 
 AnimatorPool::Animator::Animator(AnimatorPool &owner) :
 	owner(owner), tEpoch(owner._tEpoch), tLast(owner._tEpoch) {}
 
 void AnimatorPool::Animator::renderFrame() {
-	auto tNow = std::chrono::time_point_cast<duration>(clock::now());
+	auto tNow = owner._tFrame;
 
 	frame_time_t t  = (tNow - tEpoch).count();
 	frame_time_t dt = (tNow - tLast).count();
 	tLast           = tNow;
 
+	const auto &offsets = owner._offsets;
 	for (const auto &sa : animations) {
-		sa.animation->iterate()(
-			sa.leds.data(), sa.leds.size(), sa.animation->userdata(), dt, t);
+		if (sa.leds.size() < 1) continue;
+
+		// only pure animations are independent of the LEDs they are iterated
+		// with, others are rendered in one call for their first LED's offset
+		if (owner._offsetsUniform || !(sa.animation->flags() & ANIMATION_PURE)) {
+			const frame_time_t offset = owner.offsetOf(sa.leds.data()[0]);
+			sa.animation->render(sa.leds.data(), sa.leds.size(), dt, t + offset);
+			continue;
+		}
+
+		// LEDs of different egress instances are rendered for different times.
+		// Only the first range receives dt.
+		frame_time_t rangeDt = dt;
+		auto         first   = sa.leds.begin();
+		for (const auto &range : offsets) {
+			auto last = std::lower_bound(first, sa.leds.end(), range.first);
+			if (last != first) {
+				sa.animation->render(&*first, last - first, rangeDt, t + range.second);
+				rangeDt = 0;
+			}
+			first = last;
+		}
+		if (first != sa.leds.end()) {
+			sa.animation->render(&*first, sa.leds.end() - first, rangeDt, t);
+		}
 	}
 }
 
+void AnimatorPool::beginFrame() {
+	beginFrame(std::chrono::time_point_cast<duration>(clock::now()));
+}
+
+void AnimatorPool::beginFrame(time_point tFrame) {
+	_tFrame = tFrame;
+	Frame::SetAnimTime(tFrame.time_since_epoch().count());
+}
+
 AnimatorPool::AnimatorPool() :
 	_tEpoch(std::chrono::time_point_cast<duration>(clock::now())) {}
 
@@ -137,7 +326,35 @@ void AnimatorPool::setup(size_t animatorCount) {
 	}
 }
 
+frame_time_t AnimatorPool::offsetOf(led_i_t led) const {
+	for (const auto &range : _offsets) {
+		if (led < range.first) return range.second;
+	}
+	return 0;
+}
+
 void AnimatorPool::flush() {
+	// measured offsets are smoothed but never exactly equal, so they are
+	// quantised to whole frame periods. An offset only moves once it is off by
+	// 3/4 of a period to keep ranges from toggling between frames.
+	EgressInstance::PresentationOffsets(_measuredOffsets);
+	const bool keep = _offsets.size() == _measuredOffsets.size();
+	_offsets.resize(_measuredOffsets.size());
+	_offsetsUniform = true;
+	for (size_t i = 0; i < _offsets.size(); i++) {
+		const frame_time_t measured = _measuredOffsets[i].second;
+		frame_time_t       offset   = measured;
+		if (_framePeriod > 0) {
+			offset = std::round(measured / _framePeriod) * _framePeriod;
+			if (
+				keep && (std::abs(measured - _offsets[i].second) < 0.75 * _framePeriod)) {
+				offset = _offsets[i].second;
+			}
+		}
+		_offsets[i]     = {_measuredOffsets[i].first, offset};
+		_offsetsUniform &= (offset == _offsets[0].second);
+	}
+
 	if (_AnimationDropped) {
 		for (auto it = _AnimationMap.begin(); it != _AnimationMap.end();) {
 			if (it->second->usageCount() < 2) {
@@ -150,7 +367,27 @@ void AnimatorPool::flush() {
 	}
 	if (_dirty) {
 		for (auto &animator : _animators) {
-			animator->animations = animator->nextAnimations;
+			// sharers of a pure animation are merged into a single iteration of
+			// their source over the union of their LEDs
+			animator->animations.clear();
+			for (const auto &sa : animator->nextAnimations) {
+				const auto &animation =
+					sa.animation->source() ? sa.animation->source() : sa.animation;
+				auto it = animator->animations.end();
+				if (animation->flags() & ANIMATION_PURE) {
+					it = std::find_if(
+						animator->animations.begin(),
+						animator->animations.end(),
+						[&](const SubAnimation &other) {
+							return other.animation == animation;
+						});
+				}
+				if (it == animator->animations.end()) {
+					animator->animations.push_back({animation, sa.leds});
+				} else {
+					it->leds += sa.leds;
+				}
+			}
 		}
 		_dirty = false;
 	}
@@ -197,13 +434,46 @@ void AnimatorPool::clear() {
 }
 
 void AnimatorPool::install(std::shared_ptr<Animation> animation) {
-	clear(animation->leds());
+	install(animation, animation->leds());
+}
+
+void AnimatorPool::install(
+	std::shared_ptr<Animation> animation, const LEDSet &leds) {
+	clear(leds);
 	// we put all animations into the first animator here. A call to flush()
 	// redistributes for load balancing.
-	_animators.back()->nextAnimations.emplace_back(animation, animation->leds());
+	_animators.back()->nextAnimations.emplace_back(animation, leds);
 	_dirty = true;
 }
 
+// removes a `rate=<hz>` token from an animation's argument string, storing
+// its value in rate (or -1 if there is none)
+static std::string _ExtractRate(const char *argstr, float &rate) {
+	std::string args(argstr ? argstr : "");
+	rate = -1;
+	for (size_t p = 0; p < args.size();) {
+		if (isspace((unsigned char)args[p])) {
+			p++;
+			continue;
+		}
+		size_t end = p;
+		while (end < args.size() && !isspace((unsigned char)args[end])) end++;
+		if (args.compare(p, 5, "rate=") == 0) {
+			char *      tail;
+			const char *value = args.c_str() + p + 5;
+			const float hz    = strtof(value, &tail);
+			if (tail != value && tail == args.c_str() + end && hz >= 0) {
+				rate = hz;
+				while (end < args.size() && isspace((unsigned char)args[end])) end++;
+				args.erase(p, end - p);
+				continue;
+			}
+		}
+		p = end;
+	}
+	return args;
+}
+
 extern "C" {
 
 void anim_status() {
@@ -212,7 +482,14 @@ void anim_status() {
 	for (auto it : _AnimationMap) {
 		msg << "  #" << it.second->animno() << ": " << it.second->ident()
 				<< " uc:" << it.second->usageCount()
-				<< " leds:" << it.second->leds().size() << "\n";
+				<< " leds:" << it.second->leds().size();
+		if (it.second->rate() > 0) msg << " rate:" << it.second->rate();
+		if (it.second->source()) {
+			msg << " shares #" << it.second->source()->animno();
+		} else if (it.second->shared()) {
+			msg << " shared";
+		}
+		msg << "\n";
 	}
 	msg << alp::over;
 }
@@ -226,10 +503,42 @@ animno_t anim_init(
 		return INVALID_ANIMATION;
 	}
 
+	float             rate;
+	const std::string args = _ExtractRate(argstr, rate);
+	if (rate < 0) {
+		auto declared =
+			reinterpret_cast<const float *>(basemodule_resolve(bmod, "Rate"));
+		rate = declared ? *declared : 0;
+	}
+
+	// pure animations with identical arguments are shared: each user gets its
+	// own handle tracking its LEDs, rendering is done by a common source
+	if (auto flags = reinterpret_cast<const unsigned *>(
+				basemodule_resolve(bmod, "Flags"));
+			flags && (*flags & ANIMATION_PURE)) {
+		std::shared_ptr<Animation> source;
+		for (auto &it : _AnimationMap) {
+			auto &animation = *it.second;
+			if (
+				(animation.ident() != ident) || !(animation.flags() & ANIMATION_PURE)
+				|| (animation.argstring() != args)
+				|| (animation.rate() != rate))
+				continue;
+			source = animation.source() ? animation.source() : it.second;
+			break;
+		}
+		if (source) {
+			auto animation = std::make_shared<Animation>(source, ledv, ledn);
+			_AnimationMap[animation->animno()] = animation;
+			return animation->animno();
+		}
+	}
+
 	{
 		auto animation = std::make_shared<Animation>(ident, bmod);
 		animation->setLEDs(ledv, ledn);
-		animation->initialize(argstr);
+		animation->setRate(rate);
+		animation->initialize(args);
 		_AnimationMap[animation->animno()] = animation;
 		return animation->animno();
 	}
@@ -256,7 +565,8 @@ void anim_restrict(animno_t anim, const led_i_t *ledv, size_t ledn) {
 		envelope.append(ledv, ledn);
 		it->second->restrict(envelope);
 
-		AnimatorPool::Get().install(it->second);
+		envelope %= it->second->leds();
+		AnimatorPool::Get().install(it->second, envelope);
 	}
 }
 
@@ -265,6 +575,14 @@ void anim_install(animno_t anim) {
 		AnimatorPool::Get().install(it->second);
 	}
 }
+void anim_install_subset(animno_t anim, const led_i_t *ledv, size_t ledn) {
+	if (auto it = _AnimationMap.find(anim); it != _AnimationMap.end()) {
+		LEDSet leds;
+		leds.append(ledv, ledn);
+		leds %= it->second->leds();
+		AnimatorPool::Get().install(it->second, leds);
+	}
+}
 void anim_uninstall(animno_t anim) {
 	if (auto it = _AnimationMap.find(anim); it != _AnimationMap.end()) {
 		AnimatorPool::Get().clear(it->second->leds());
@@ -302,10 +620,25 @@ void anim_render(
 	frame_time_t   dt,
 	frame_time_t   t) {
 	if (auto it = _AnimationMap.find(anim); it != _AnimationMap.end()) {
-		it->second->iterate()(ledv, ledn, it->second->userdata(), dt, t);
+		it->second->render(ledv, ledn, dt, t);
 	}
 }
 
+void anim_render_to(
+	animno_t       anim,
+	const led_i_t *ledv,
+	size_t         ledn,
+	led_t *        dst,
+	frame_time_t   dt,
+	frame_time_t   t) {
+	auto it = _AnimationMap.find(anim);
+	if (it == _AnimationMap.end()) return;
+
+	Animation &animation = *it->second;
+	_RenderDense(
+		ledv, ledn, dst, [&]() { animation.render(ledv, ledn, dt, t); });
+}
+
 void anim_cleanup() {
 	AnimatorPool::Get().clear();
 	_AnimationMap.clear();
@@ -28,6 +28,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include <filesystem>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <ratio>
 #include <string>
 #include <thread>
@@ -52,9 +53,38 @@ protected:
 	size_t _usageCount  = 0;
 	bool   _initialized = false;
 
+	unsigned    _flags = 0;
+	std::string _argstring;
+	size_t      _shareCount = 0;
+
 	void * _userdata = nullptr;
 	LEDSet _leds;
 
+	// set for sharers of a pure animation: this instance only tracks the
+	// sharer's LEDs and usage, rendering is done by source
+	std::shared_ptr<Animation> _source;
+
+	// update rate decimation: keyframes rendered at the start of the current
+	// and the next period. They are frame-sized and shared by all LED ranges
+	// the instance is rendered for. Pure animations iterate each LED once per
+	// keyframe on first use, others are iterated over the whole ledv at once
+	// and only once per period. Guarded by a mutex as sharers may be rendered
+	// from several animators concurrently.
+	struct Keyframes {
+		std::vector<led_t>   k0;
+		std::vector<led_t>   k1;
+		std::vector<char>    have0; // LEDs already rendered into k0
+		std::vector<char>    have1;
+		std::vector<led_i_t> missing;
+		std::vector<led_i_t> leds; // ledv keyframes of impure animations cover
+		long                 index = 0; // period index of k0
+		bool                 valid = false;
+	};
+
+	float      _rate = 0;
+	Keyframes  _keyframes;
+	std::mutex _keyframeMutex;
+
 public:
 	static void LEDsRemoved(led_i_t offset, led_i_t count);
 
@@ -65,6 +95,9 @@ public:
 		animation_iterate_t iterate,
 		animation_deinit_f  deinit,
 		void *              userdata);
+	// sharer of the pure animation source, covering the LEDs at ledv
+	Animation(
+		std::shared_ptr<Animation> source, const led_i_t *ledv, size_t ledn);
 	Animation(const Animation &) = delete;
 	Animation(Animation &&)      = default;
 	~Animation();
@@ -78,14 +111,34 @@ public:
 	size_t usageCount() const { return _usageCount; }
 	bool   initialized() const { return _initialized; }
 
+	unsigned           flags() const { return _flags; }
+	const std::string &argstring() const { return _argstring; }
+	bool               shared() const { return _shareCount > 0 || _source; }
+	const std::shared_ptr<Animation> &source() const { return _source; }
+
 	void *        userdata() const { return _userdata; }
 	const LEDSet &leds() const { return _leds; }
 
+	// update rate in Hz, 0 to render every frame
+	float rate() const { return _rate; }
+	void  setRate(float rate) {
+		std::lock_guard<std::mutex> lock(_keyframeMutex);
+		_rate             = rate;
+		_keyframes.valid = false;
+	}
+
 	void restrict(const LEDSet &envelope) { _leds %= envelope; }
 
 	void setLEDs(const led_i_t *ledv, size_t ledn);
 	void initialize(const std::string &argstring);
-	void doIterate(frame_time_t dt, frame_time_t t) const;
+	void doIterate(frame_time_t dt, frame_time_t t);
+
+	// renders the animation into frame_raw_anim(). With an update rate set, the
+	// animation itself is only iterated at multiples of the rate's period and
+	// LEDs are interpolated between the surrounding keyframes in between, so
+	// the output remains a function of t.
+	void
+	render(const led_i_t *ledv, size_t ledn, frame_time_t dt, frame_time_t t);
 
 	void grab() { _usageCount++; }
 	void drop() { _usageCount--; }
@@ -118,6 +171,18 @@ protected:
 	time_point                             _tEpoch;
 	bool                                   _dirty = false;
 	std::vector<std::unique_ptr<Animator>> _animators;
+	time_point                             _tFrame;
+
+	// presentation time offsets per egress, as (end of LED range, offset),
+	// quantised to whole frame periods
+	std::vector<std::pair<led_i_t, frame_time_t>> _offsets;
+	std::vector<std::pair<led_i_t, frame_time_t>> _measuredOffsets;
+	bool                                          _offsetsUniform = true;
+	frame_time_t                                  _framePeriod    = 0;
+
+	// offset of the egress range containing led
+	frame_time_t offsetOf(led_i_t led) const;
+
 	AnimatorPool();
 
 public:
@@ -126,6 +191,15 @@ public:
 	void                 flush();
 	size_t               animatorCount() const { return _animators.size(); }
 
+	// sets the time of the next frame to render, the current one by default.
+	// Animations are passed this time plus the predicted delay until their
+	// LEDs are presented by egress.
+	void beginFrame();
+	void beginFrame(time_point tFrame);
+
+	// sets the period presentation offsets are quantised to
+	void setFramePeriod(duration period) { _framePeriod = period.count(); }
+
 	void renderFrame(size_t iAnimator) {
 		if (iAnimator < _animators.size()) _animators[iAnimator]->renderFrame();
 	}
@@ -134,5 +208,6 @@ public:
 	void clear();
 	void clear(const LEDSet &leds);
 	void install(std::shared_ptr<Animation> animation);
+	void install(std::shared_ptr<Animation> animation, const LEDSet &leds);
 };
 #endif
\ No newline at end of file
@@ -42,6 +42,12 @@ typedef void (*animation_iterate_t)(
 	frame_time_t   dt,
 	frame_time_t   t);
 
+// Animation modules may export `const unsigned Flags` combining the following:
+//  ANIMATION_PURE: output only depends on LED index, coordinates, arguments and
+//    t - not on the LEDs passed to init, their order, dt or randomness. Such
+//    animations are shared between display commands with identical arguments.
+#define ANIMATION_PURE (1u << 0)
+
 typedef struct animation_prototype_t {
 	animation_init_f    init;
 	animation_deinit_f  deinit;
@@ -64,6 +70,8 @@ animno_t anim_define(
 void anim_restrict(animno_t anim, const led_i_t *ledv, size_t ledn);
 
 void anim_install(animno_t anim);
+// installs anim on the given subset of its LEDs only
+void anim_install_subset(animno_t anim, const led_i_t *ledv, size_t ledn);
 void anim_uninstall(animno_t anim);
 void anim_clear(const led_i_t *ledv, size_t ledn);
 void anim_clearAll();
@@ -77,6 +85,17 @@ void anim_render(
 	frame_time_t   dt,
 	frame_time_t   t);
 
+// renders anim into a dense buffer (dst[i] corresponds to ledv[i]) without
+// touching the frame seen by other animations. May be nested and called from
+// multiple render threads.
+void anim_render_to(
+	animno_t       anim,
+	const led_i_t *ledv,
+	size_t         ledn,
+	led_t *        dst,
+	frame_time_t   dt,
+	frame_time_t   t);
+
 void anim_cleanup();
 #ifdef __cplusplus
 }
@@ -26,10 +26,12 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/frame_api.h"
 #include "core/module.hpp"
 #include "core/module_api.h"
+#include "core/workers_api.h"
 #include "util/module.hpp"
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <string>
 #include <unordered_map>
 
 static std::vector<std::shared_ptr<EgressInstance>> _EgressList;
@@ -39,14 +41,66 @@ static std::unordered_map<std::string, std::shared_ptr<EgressInstance>>
 static animno_t _EgressCount = 0;
 static animno_t AllocateEgressNumber() { return ++_EgressCount; }
 
+static double _Smooth(double avg, double sample) {
+	return avg > 0 ? avg + (sample - avg) * 0.05 : sample;
+}
+
+void EgressInstance::present(led_i_t offset, double tFrame) {
+	const auto t0 = std::chrono::steady_clock::now();
+	_flush(offset, _count, _userdata);
+	const auto t1 = std::chrono::steady_clock::now();
+
+	_flushTime =
+		_Smooth(_flushTime, std::chrono::duration<double>(t1 - t0).count());
+	if (tFrame > 0) {
+		const double tNow =
+			std::chrono::duration<double>(t1.time_since_epoch()).count();
+		_pipeline = _Smooth(_pipeline, tNow - tFrame);
+	}
+}
+
+struct FlushJob {
+	EgressInstance *egress;
+	led_i_t         offset;
+};
+
+static std::vector<FlushJob> _ParallelFlush;
+static std::vector<FlushJob> _SerialFlush;
+static double                _FlushTFrame = 0;
+
+static void _FlushTask(size_t index, void *) {
+	_ParallelFlush[index].egress->present(
+		_ParallelFlush[index].offset, _FlushTFrame);
+}
+
 void EgressInstance::Flush() {
+	_FlushTFrame   = Frame::EgressTime();
 	led_i_t offset = 0;
-	for (auto egress : _EgressList) {
+	_ParallelFlush.clear();
+	_SerialFlush.clear();
+	for (auto &egress : _EgressList) {
 		if (egress->active && egress->flush()) {
-			egress->flush()(offset, egress->_count, egress->userdata());
+			auto &jobs = (egress->_flags & EGRESS_SERIAL) ? _SerialFlush
+																										: _ParallelFlush;
+			jobs.emplace_back(FlushJob{egress.get(), offset});
 		}
 		offset += egress->_count;
 	}
+
+	// all flushes complete before returning, i.e. before the next frame is
+	// written to the egress buffer
+	workers_run(_ParallelFlush.size(), _FlushTask, nullptr);
+	for (auto &job : _SerialFlush) job.egress->present(job.offset, _FlushTFrame);
+}
+
+void EgressInstance::PresentationOffsets(
+	std::vector<std::pair<led_i_t, double>> &offsets) {
+	offsets.clear();
+	led_i_t offset = 0;
+	for (auto &egress : _EgressList) {
+		offset += egress->_count;
+		offsets.emplace_back(offset, egress->_pipeline + egress->latency);
+	}
 }
 
 EgressInstance::EgressInstance(
@@ -66,6 +120,12 @@ EgressInstance::EgressInstance(
 		reinterpret_cast<egress_deinit_f>(basemodule_resolve(basemodno, "deinit"));
 	_flush =
 		reinterpret_cast<egress_flush_t>(basemodule_resolve(basemodno, "flush"));
+	_status =
+		reinterpret_cast<egress_status_f>(basemodule_resolve(basemodno, "status"));
+	if (auto flags = reinterpret_cast<const unsigned *>(
+				basemodule_resolve(basemodno, "Flags"))) {
+		_flags = *flags;
+	}
 
 	if (!_flush) {
 		LOG(E) << "bad egress module " << _ident << " - has no flush function"
@@ -97,7 +157,25 @@ void egress_status() {
 	for (auto it : _EgressMap) {
 		msg << "  #" << it.first << " (" << it.second->ident() << " "
 				<< it.second->instanceName() << ") count:" << it.second->count()
-				<< " active:" << it.second->active << "\n";
+				<< " active:" << it.second->active
+				<< (it.second->flags() & EGRESS_SERIAL ? " (serial)" : "")
+				<< " flush:" << (it.second->flushTime() * 1e3) << "ms"
+				<< " pipeline:" << (it.second->pipeline() * 1e3) << "ms"
+				<< " latency:" << (it.second->latency * 1e3) << "ms";
+		if (auto status = it.second->status()) {
+			// retry once with the reported length; counters may have grown in
+			// between, in which case the second line is truncated
+			std::string line(256, '\0');
+			size_t      len =
+				status(it.second->userdata(), line.data(), line.size() + 1);
+			if (len > line.size()) {
+				line.resize(len);
+				len = status(it.second->userdata(), line.data(), line.size() + 1);
+			}
+			line.resize(std::min(len, line.size()));
+			msg << "\n   " << line;
+		}
+		msg << "\n";
 	}
 	msg << alp::over;
 }
@@ -208,6 +286,12 @@ void egress_set_active(egressno_t egressno, int active) {
 	}
 }
 
+void egress_set_latency(egressno_t egressno, double seconds) {
+	if (auto it = _EgressMap.find(egressno); it != _EgressMap.end()) {
+		it->second->latency = seconds;
+	}
+}
+
 void egress_remove(egressno_t egress) {
 	led_i_t offset = 0;
 	for (auto it = _EgressList.begin(), end = _EgressList.end(); it != end;
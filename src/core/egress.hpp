@@ -40,18 +40,36 @@ protected:
 	egress_init_f   _init;
 	egress_deinit_f _deinit;
 	egress_flush_t  _flush;
+	egress_status_f _status;
+	unsigned        _flags = 0;
 
 	void *_userdata = nullptr;
 
 	led_i_t     _count;
 	std::string _instanceName;
 
+	// smoothed delay from the time a frame was rendered for until this
+	// instance's flush returned, in seconds
+	double _pipeline = 0;
+
+	// smoothed duration of this instance's flush call, in seconds
+	double _flushTime = 0;
+
 public:
 	static void Flush();
 
+	// fills offsets with the predicted presentation delay of each instance's
+	// LEDs, as (end of LED range, pipeline delay plus configured latency)
+	static void
+	PresentationOffsets(std::vector<std::pair<led_i_t, double>> &offsets);
+
 public:
 	bool active = true;
 
+	// additional delay of the transport behind this instance, e.g. buffering
+	// in a network controller, in seconds
+	double latency = 0;
+
 	EgressInstance(
 		const std::string &ident,
 		basemodno_t        basemodno,
@@ -68,10 +86,18 @@ public:
 	egress_init_f      init() const { return _init; }
 	egress_deinit_f    deinit() const { return _deinit; }
 	egress_flush_t     flush() const { return _flush; }
+	egress_status_f    status() const { return _status; }
+	unsigned           flags() const { return _flags; }
 
 	void *userdata() const { return _userdata; }
 
+	// flushes this instance's LEDs, located at offset in the egress frame, and
+	// updates its timings. tFrame is the time the frame was rendered for.
+	void present(led_i_t offset, double tFrame);
+
 	led_i_t count() const { return _count; }
+	double  pipeline() const { return _pipeline; }
+	double  flushTime() const { return _flushTime; }
 
 	const std::string &instanceName() const { return _instanceName; }
 };
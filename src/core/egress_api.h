@@ -40,6 +40,17 @@ typedef void (*egress_init_f)(
 	egressno_t egressno, const char *argstr, void **puserdata);
 typedef void (*egress_deinit_f)(void *userdata);
 typedef void (*egress_flush_t)(led_i_t firstLED, led_i_t count, void *userdata);
+// optional: writes a status line (e.g. transport counters) of up to size bytes
+// to buf and returns its length as snprintf would. If the line did not fit, it
+// is requested again with a buffer large enough for the returned length.
+typedef size_t (*egress_status_f)(void *userdata, char *buf, size_t size);
+
+// Egress modules may export `const unsigned Flags` combining the following:
+//  EGRESS_SERIAL: flush is not thread-safe, e.g. because it shares state or a
+//    file with other instances. Such instances are flushed one after another
+//    on the main thread, all others are flushed concurrently on the worker
+//    pool, each reading only its own range of the egress frame.
+#define EGRESS_SERIAL (1u << 0)
 
 void egress_status();
 
@@ -60,6 +71,9 @@ egressno_t egress_find(const char *instanceName, egress_info_t *inf);
 int        egress_info(egressno_t egress, egress_info_t *inf);
 led_i_t    egress_offset(egressno_t egress);
 void       egress_set_active(egressno_t egress, int active);
+// sets the transport latency behind an egress instance, which animations
+// rendering its LEDs are compensated for in addition to the measured delay
+void egress_set_latency(egressno_t egress, double seconds);
 
 
 void egress_remove(egressno_t egress);
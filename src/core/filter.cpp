@@ -0,0 +1,82 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "core/filter.hpp"
+#include "core/frame_api.h"
+#include "core/workers_api.h"
+#include <algorithm>
+
+FilterPipeline &FilterPipeline::Get() {
+	static FilterPipeline pipeline;
+	return pipeline;
+}
+
+filterno_t
+FilterPipeline::add(modno_t modno, filter_kernel_f kernel, void *userdata) {
+	_filters.push_back({++_filterCount, modno, kernel, userdata, true});
+	return _filterCount;
+}
+
+void FilterPipeline::setActive(filterno_t filterno, bool active) {
+	for (auto &filter : _filters) {
+		if (filter.filterno == filterno) filter.active = active;
+	}
+}
+
+void FilterPipeline::remove(filterno_t filterno) {
+	std::erase_if(
+		_filters, [&](const Filter &filter) { return filter.filterno == filterno; });
+}
+
+void FilterPipeline::removeModule(modno_t modno) {
+	std::erase_if(
+		_filters, [&](const Filter &filter) { return filter.modno == modno; });
+}
+
+void FilterPipeline::_Chunk(size_t index, void *userdata) {
+	auto &       self  = *(FilterPipeline *)userdata;
+	const size_t first = index * ChunkSize;
+	const size_t count = std::min(ChunkSize, self._ledn - first);
+	for (const auto &filter : self._active) {
+		filter.kernel(self._leds + first, first, count, filter.userdata);
+	}
+}
+
+void FilterPipeline::apply() {
+	_active.clear();
+	for (const auto &filter : _filters) {
+		if (filter.active) _active.push_back(filter);
+	}
+	_ledn = frame_size();
+	if (_active.empty() || _ledn < 1) return;
+	_leds = frame_raw_egress();
+	workers_run((_ledn + ChunkSize - 1) / ChunkSize, _Chunk, this);
+}
+
+extern "C" {
+
+filterno_t
+filter_register(modno_t modno, filter_kernel_f kernel, void *userdata) {
+	return FilterPipeline::Get().add(modno, kernel, userdata);
+}
+
+void filter_set_active(filterno_t filter, int active) {
+	FilterPipeline::Get().setActive(filter, active);
+}
+
+void filter_remove(filterno_t filter) { FilterPipeline::Get().remove(filter); }
+}
@@ -0,0 +1,62 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_FILTER_HPP
+#define CORE_FILTER_HPP
+
+#include "core/filter_api.h"
+#include <vector>
+
+// Filters registered via filter_api.h, applied to the egress frame in one
+// chunked pass before the applyFilter hook is triggered.
+class FilterPipeline {
+public:
+	// LEDs per chunk, small enough for a chunk to stay in cache while all
+	// filters run on it
+	static constexpr size_t ChunkSize = 2048;
+
+	struct Filter {
+		filterno_t      filterno;
+		modno_t         modno;
+		filter_kernel_f kernel;
+		void *          userdata;
+		bool            active;
+	};
+
+protected:
+	std::vector<Filter> _filters;
+	std::vector<Filter> _active;
+	filterno_t          _filterCount = 0;
+	led_t *             _leds        = nullptr;
+	size_t              _ledn        = 0;
+
+	FilterPipeline() {}
+	static void _Chunk(size_t index, void *userdata);
+
+public:
+	static FilterPipeline &Get();
+
+	filterno_t add(modno_t modno, filter_kernel_f kernel, void *userdata);
+	void       setActive(filterno_t filterno, bool active);
+	void       remove(filterno_t filterno);
+	void       removeModule(modno_t modno);
+	void       clear() { _filters.clear(); }
+
+	void apply();
+};
+
+#endif
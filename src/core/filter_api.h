@@ -0,0 +1,52 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_FILTER_API_H
+#define CORE_FILTER_API_H
+
+#include "core/frame_api.h"
+#include "core/module_api.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef size_t filterno_t;
+#define INVALID_FILTER ((filterno_t)0)
+
+// transforms count LEDs of the egress frame in place, leds pointing to LED
+// first. The pipeline splits the frame into chunks, runs all active filters
+// on one chunk before moving on to the next and spreads chunks across the
+// worker pool, so kernels must not use any other API.
+typedef void (*filter_kernel_f)(
+	led_t *leds, led_i_t first, size_t count, void *userdata);
+
+// registers a filter kernel, applied after those registered earlier. Filters
+// are removed along with their module.
+filterno_t filter_register(modno_t modno, filter_kernel_f kernel, void *userdata);
+
+// inactive filters are skipped entirely, e.g. while they would not change
+// any LED
+void filter_set_active(filterno_t filter, int active);
+void filter_remove(filterno_t filter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
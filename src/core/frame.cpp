@@ -30,6 +30,11 @@ static std::vector<led_t> _frame_preanim;
 static std::vector<led_t> _frame_anim;
 static std::vector<led_t> _frame_egress;
 
+static double _frame_anim_time   = 0;
+static double _frame_egress_time = 0;
+
+static thread_local led_t *_frame_anim_target = nullptr;
+
 void Frame::LEDsAdded(led_i_t count) {
 	_frame_preanim.resize(_frame_preanim.size() + count, {0, 0, 0});
 }
@@ -44,15 +49,34 @@ void Frame::LEDsRemoved(led_i_t offset, led_i_t count) {
 
 void Frame::FlushAnim() { _frame_anim = _frame_preanim; }
 void Frame::FlushEgress() {
-	_frame_egress  = _frame_anim;
-	_frame_preanim = _frame_anim;
+	_frame_egress      = _frame_anim;
+	_frame_preanim     = _frame_anim;
+	_frame_egress_time = _frame_anim_time;
+}
+
+void Frame::FlushPreanim() { _frame_preanim = _frame_anim; }
+void Frame::PresentEgress(std::vector<led_t> &leds, double time) {
+	std::swap(_frame_egress, leds);
+	_frame_egress_time = time;
+}
+
+void   Frame::SetAnimTime(double time) { _frame_anim_time = time; }
+double Frame::EgressTime() { return _frame_egress_time; }
+
+led_t *Frame::RedirectAnim(led_t *target) {
+	led_t *prev        = _frame_anim_target;
+	_frame_anim_target = target;
+	return prev;
 }
 
 extern "C" {
 
 size_t frame_size() { return _frame_preanim.size(); }
+double frame_anim_time() { return _frame_anim_time; }
 
 led_t *frame_raw_preanim() { return _frame_preanim.data(); }
-led_t *frame_raw_anim() { return _frame_anim.data(); }
+led_t *frame_raw_anim() {
+	return _frame_anim_target ? _frame_anim_target : _frame_anim.data();
+}
 led_t *frame_raw_egress() { return _frame_egress.data(); }
 }
\ No newline at end of file
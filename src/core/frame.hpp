@@ -19,12 +19,27 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #define CORE_FRAME_HPP
 
 #include "core/frame_api.h"
+#include <vector>
 class Frame {
 public:
 	static void LEDsAdded(led_i_t count);
 	static void LEDsRemoved(led_i_t offset, led_i_t count);
 	static void FlushAnim();
 	static void FlushEgress();
+
+	// render-ahead counterparts of FlushEgress: the next frame builds upon the
+	// one just rendered, while egress is handed queued frames separately
+	static void FlushPreanim();
+	static void PresentEgress(std::vector<led_t> &leds, double time);
+
+	// time the anim frame is rendered for, in seconds on the steady clock,
+	// passed on to the egress frame along with the LED data
+	static void   SetAnimTime(double time);
+	static double EgressTime();
+
+	// redirects frame_raw_anim() of the calling thread to target (nullptr
+	// restores the shared frame), returning the previous redirection
+	static led_t *RedirectAnim(led_t *target);
 };
 
 #endif
\ No newline at end of file
@@ -41,6 +41,14 @@ led_t *frame_raw_preanim();
 led_t *frame_raw_anim();
 led_t *frame_raw_egress();
 
+// time the anim frame being rendered is due, in seconds on the steady clock.
+// Unlike the t passed to animations, this includes no per-egress offsets and
+// thus identifies the frame.
+double frame_anim_time();
+
+// reports the state of the render-ahead frame queue
+void frame_status();
+
 #ifdef __cplusplus
 }
 #endif
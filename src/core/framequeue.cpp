@@ -0,0 +1,122 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "core/framequeue.hpp"
+#include "alpha4/common/logger.hpp"
+#include "util/module.hpp"
+#include <algorithm>
+
+FrameQueue &FrameQueue::Get() {
+	static FrameQueue queue;
+	return queue;
+}
+
+void FrameQueue::setup(size_t depth, duration interval) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_slots.clear();
+	_slots.resize(depth);
+	_first     = 0;
+	_count     = 0;
+	_interval  = interval;
+	_tLastTick = std::chrono::time_point_cast<duration>(clock::now());
+	_stop      = false;
+}
+
+bool FrameQueue::reserve(time_point &tTarget) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_condFree.wait(lock, [&] { return _stop || (_count < _slots.size()); });
+	if (_stop) return false;
+	tTarget = _tLastTick + _interval * (double)(_count + 1);
+	return true;
+}
+
+void FrameQueue::push(
+	const led_t *leds, size_t ledn, time_point tTarget, time_point tRendered) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (_count >= _slots.size()) return;
+	Slot &slot = _slots[(_first + _count) % _slots.size()];
+	slot.leds.assign(leds, leds + ledn);
+	slot.tTarget   = tTarget;
+	slot.tRendered = tRendered;
+	_count++;
+}
+
+bool FrameQueue::pop(
+	std::vector<led_t> &dst,
+	size_t              ledn,
+	time_point          tNow,
+	time_point &        tTarget) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_tLastTick = tNow;
+	for (; _count > 0; _count--, _first = (_first + 1) % _slots.size()) {
+		Slot &slot = _slots[_first];
+		if (slot.leds.size() != ledn) {
+			_dropped++;
+			continue;
+		}
+
+		const duration latency = tNow - slot.tRendered;
+		_latencySum += latency;
+		_latencyMax = std::max(_latencyMax, latency);
+		_latenessSum += tNow - slot.tTarget;
+		_presented++;
+
+		std::swap(dst, slot.leds);
+		tTarget = slot.tTarget;
+		_count--;
+		_first = (_first + 1) % _slots.size();
+		lock.unlock();
+		_condFree.notify_one();
+		return true;
+	}
+
+	// the queue filling up initially does not count as an underrun
+	if (_presented > 0) _underruns++;
+	lock.unlock();
+	_condFree.notify_one();
+	return false;
+}
+
+void FrameQueue::stop() {
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condFree.notify_all();
+}
+
+void FrameQueue::status() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (_slots.empty()) {
+		RESPOND(I) << "frame queue: disabled" << alp::over;
+		return;
+	}
+	const double n = std::max<size_t>(_presented, 1);
+	RESPOND(I) << "frame queue: depth:" << _slots.size() << " queued:" << _count
+						 << " presented:" << _presented << " underruns:" << _underruns
+						 << " dropped:" << _dropped
+						 << " latency:" << (_latencySum.count() / n * 1e3) << "ms avg "
+						 << (_latencyMax.count() * 1e3) << "ms max"
+						 << " lateness:" << (_latenessSum.count() / n * 1e3)
+						 << "ms avg" << alp::over;
+}
+
+extern "C" {
+
+void frame_status() { FrameQueue::Get().status(); }
+}
@@ -0,0 +1,90 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_FRAMEQUEUE_HPP
+#define CORE_FRAMEQUEUE_HPP
+
+#include "core/animation.hpp"
+#include "core/frame_api.h"
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Ring of frames rendered ahead of time. The render loop reserves a slot,
+// renders the frame for the slot's target time and pushes it, the presenting
+// thread pops one frame per tick and hands it to egress. Target times assume
+// every tick presents a frame, so they follow the presenting thread's actual
+// schedule rather than accumulating drift.
+class FrameQueue {
+public:
+	using duration   = AnimatorPool::duration;
+	using clock      = AnimatorPool::clock;
+	using time_point = AnimatorPool::time_point;
+
+	struct Slot {
+		std::vector<led_t> leds;
+		time_point         tTarget;   // when the frame is meant to be shown
+		time_point         tRendered; // when rendering of the frame started
+	};
+
+protected:
+	std::mutex              _mutex;
+	std::condition_variable _condFree;
+	std::vector<Slot>       _slots;
+	size_t                  _first = 0;
+	size_t                  _count = 0;
+	duration                _interval{0};
+	time_point              _tLastTick;
+	bool                    _stop = false;
+
+	size_t   _presented = 0;
+	size_t   _underruns = 0;
+	size_t   _dropped   = 0;
+	duration _latencySum{0};
+	duration _latencyMax{0};
+	duration _latenessSum{0};
+
+	FrameQueue() {}
+
+public:
+	static FrameQueue &Get();
+
+	// sets the number of frames rendered ahead, 0 disabling the queue
+	void   setup(size_t depth, duration interval);
+	size_t depth() const { return _slots.size(); }
+
+	// blocks until a slot is free and returns its target time, or false if the
+	// queue was stopped
+	bool reserve(time_point &tTarget);
+	void push(
+		const led_t *leds, size_t ledn, time_point tTarget, time_point tRendered);
+
+	// swaps the oldest frame of ledn LEDs into dst and sets tTarget to its
+	// target time, discarding frames rendered for a different LED count.
+	// Returns false if no frame is available.
+	bool pop(
+		std::vector<led_t> &dst,
+		size_t              ledn,
+		time_point          tNow,
+		time_point &        tTarget);
+
+	void stop();
+	void status();
+};
+
+#endif
@@ -21,6 +21,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/frame_api.h"
 #include <algorithm>
 #include <cstring>
+#include <iterator>
 #include <type_traits>
 #include <vector>
 struct LEDSet {
@@ -90,10 +91,26 @@ public:
 		return *this;
 	}
 
-	LEDSet &operator+=(const LEDSet leds) {
-		_storage.insert(_storage.end(), leds.begin(), leds.end());
-		_sorted = false;
+	LEDSet &operator+=(const LEDSet &leds) {
+		if (leds.empty()) return *this;
 		sort();
+		if (!_sorted || !leds.sorted()) {
+			// modification in progress - defer to the guard's sort
+			_storage.insert(_storage.end(), leds.begin(), leds.end());
+			_sorted = false;
+			sort();
+			return *this;
+		}
+
+		storage_type result;
+		result.reserve(_storage.size() + leds.size());
+		std::set_union(
+			_storage.begin(),
+			_storage.end(),
+			leds.begin(),
+			leds.end(),
+			std::back_inserter(result));
+		_storage = std::move(result);
 		return *this;
 	}
 
@@ -118,62 +135,45 @@ public:
 		return *this;
 	}
 
-	LEDSet &operator%=(const LEDSet leds) {
+	LEDSet &operator%=(const LEDSet &leds) {
 		if (_storage.empty()) return *this;
 		if (!leds.sorted()) {
 			LEDSet leds1 = leds;
-			leds1.sort();
+			leds1.sort(true);
 			return operator%=(leds1);
 		}
+		sort(true);
 
-		sort();
-		_storage.insert(_storage.end(), leds._storage.begin(), leds._storage.end());
-		std::sort(_storage.begin(), _storage.end());
-
-		std::vector<led_i_t> result;
+		storage_type result;
 		result.reserve(std::min(_storage.size(), leds.size()));
-
-		bool isDuplicate = false;
-		for (auto it = _storage.begin(); (it + 1) != _storage.end(); ++it) {
-			if (*it == *(it + 1)) {
-				if (!isDuplicate) {
-					isDuplicate = true;
-					result.emplace_back(*it);
-				}
-			} else {
-				isDuplicate = false;
-			}
-		}
+		std::set_intersection(
+			_storage.begin(),
+			_storage.end(),
+			leds.begin(),
+			leds.end(),
+			std::back_inserter(result));
 		_storage = std::move(result);
-		_sorted  = true;
 		return *this;
 	}
 
 	LEDSet &operator-=(const LEDSet &b) {
 		if (_storage.empty() | b.empty()) return *this;
-
-		std::vector<led_i_t> result;
-		result.reserve(_storage.size());
-
-		_storage.reserve(_storage.size() + 2 * b.size());
-		_storage.insert(_storage.end(), b._storage.begin(), b.storage().end());
-		_storage.insert(_storage.end(), b._storage.begin(), b.storage().end());
-		std::sort(_storage.begin(), _storage.end());
-
-		bool isDuplicate = false;
-		for (auto it = _storage.begin(); (it + 1) != _storage.end(); ++it) {
-			if (*it == *(it + 1)) {
-				isDuplicate = true;
-			} else {
-				if (!isDuplicate) { result.emplace_back(*it); }
-				isDuplicate = false;
-			}
+		if (!b.sorted()) {
+			LEDSet b1 = b;
+			b1.sort(true);
+			return operator-=(b1);
 		}
+		sort(true);
 
-		if (!isDuplicate) { result.emplace_back(_storage.back()); }
+		storage_type result;
+		result.reserve(_storage.size());
+		std::set_difference(
+			_storage.begin(),
+			_storage.end(),
+			b.begin(),
+			b.end(),
+			std::back_inserter(result));
 		_storage = std::move(result);
-		_sorted = true;
-
 		return *this;
 	}
 
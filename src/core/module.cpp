@@ -21,9 +21,11 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "alpha4/common/linescanner.hpp"
 #include "alpha4/common/logger.hpp"
 #include "core/basemodule_api.h"
+#include "core/filter.hpp"
 #include "module_api.h"
 #include "types/stringlist.h"
 #include "util/module.hpp"
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <mutex>
@@ -53,18 +55,75 @@ struct CommandResponder {
 
 static std::vector<CommandResponder> _CommandResponders;
 
+// Flush and hook dispatch goes through dense arrays of (function, module)
+// entries that are only modified when modules are loaded, unloaded or hook
+// into something, so per-frame dispatch is a plain loop of indirect calls.
+// Entries refer to modules by raw pointer, module_remove drops them before the
+// module is destroyed.
+//
+// Modules may be instantiated or removed from within a flush or hook, e.g. by
+// running commands. While dispatching, removal only disables the module's
+// entries and keeps the module alive; arrays are compacted, the flush array
+// recompiled and removed modules released once the outermost dispatch
+// returns. Hooks added meanwhile are appended and may already be called.
 struct Hooker {
-	modno_t               modno;
-	hook_func_f           func;
-	std::weak_ptr<Module> module;
+	modno_t       modno;
+	hook_func_f   func;
+	const Module *module;
 };
 static std::vector<std::unique_ptr<std::vector<Hooker>>> _Hookers;
 static std::unordered_map<std::string, hook_t>           _HookMap;
 
+struct Flusher {
+	modno_t        modno;
+	module_flush_f func;
+	const Module * module;
+};
+static std::vector<Flusher> _Flushers;
+
+static unsigned                             _Dispatching    = 0;
+static bool                                 _DispatchDirty  = false;
+static std::vector<std::shared_ptr<Module>> _RemovedModules = {};
+
+// rebuilds the flush dispatch array in the order modules were instantiated
+static void _CompileFlushers() {
+	_Flushers.clear();
+	for (const auto &it : _ModuleMap) {
+		if (it.second->flush()) {
+			_Flushers.emplace_back(
+				Flusher{it.first, it.second->flush(), it.second.get()});
+		}
+	}
+	std::sort(
+		_Flushers.begin(), _Flushers.end(), [](const Flusher &a, const Flusher &b) {
+			return a.modno < b.modno;
+		});
+}
+
+static void _EndDispatch() {
+	if (_DispatchDirty) {
+		for (auto &hook : _Hookers) {
+			std::erase_if(
+				*hook, [](const Hooker &hooker) { return hooker.func == nullptr; });
+		}
+		_CompileFlushers();
+		_DispatchDirty = false;
+	}
+	_RemovedModules.clear();
+}
+
+struct DispatchScope {
+	DispatchScope() { _Dispatching++; }
+	~DispatchScope() {
+		if (--_Dispatching == 0) _EndDispatch();
+	}
+};
+
 void Module::Flush() {
-	for (auto it : _ModuleMap) {
-		auto mod = it.second;
-		if (mod->_flush) mod->_flush(it.first, mod->_userdata);
+	DispatchScope scope;
+	for (size_t i = 0, n = _Flushers.size(); i < n; i++) {
+		const Flusher flusher = _Flushers[i];
+		if (flusher.func) flusher.func(flusher.modno, flusher.module->_userdata);
 	}
 }
 
@@ -172,6 +231,11 @@ modno_t module_instantiate(
 		if (res->singletonInstance()) { _Singletons[ident] = res; }
 		_ModuleMap[res->modno()] = res;
 		if (instanceName) { _ModuleNames[instanceName] = res; }
+		if (_Dispatching > 0) {
+			_DispatchDirty = true;
+		} else {
+			_CompileFlushers();
+		}
 		res->init(argstring);
 		return res->modno();
 	}
@@ -191,9 +255,25 @@ void module_remove(modno_t modno) {
 		if (mod->singletonInstance()) { _Singletons.erase(mod->ident()); }
 		if (mod->instanceName()) { _ModuleNames.erase(*mod->instanceName()); }
 		_ModuleMap.erase(it);
-		for (auto &hook : _Hookers) {
-			std::erase_if(
-				*hook, [modno](const Hooker &hooker) { return hooker.modno == modno; });
+		FilterPipeline::Get().removeModule(modno);
+		if (_Dispatching > 0) {
+			for (auto &flusher : _Flushers) {
+				if (flusher.modno == modno) flusher.func = nullptr;
+			}
+			for (auto &hook : _Hookers) {
+				for (auto &hooker : *hook) {
+					if (hooker.modno == modno) hooker.func = nullptr;
+				}
+			}
+			_DispatchDirty = true;
+			_RemovedModules.push_back(mod);
+		} else {
+			_CompileFlushers();
+			for (auto &hook : _Hookers) {
+				std::erase_if(*hook, [modno](const Hooker &hooker) {
+					return hooker.modno == modno;
+				});
+			}
 		}
 	} else {
 		RESPOND(W) << "attempted to remove non-existing module #" << modno
@@ -205,7 +285,9 @@ void module_cleanup() {
 	_ModuleNames.clear();
 	_Singletons.clear();
 	_ModuleMap.clear();
+	_Flushers.clear();
 	_CommandRegistry.clear();
+	FilterPipeline::Get().clear();
 	for (auto &hooker : _Hookers) {
 		hooker->clear();
 	}
@@ -334,15 +416,16 @@ void module_hook(modno_t modno, hook_t hook, hook_func_f func) {
 	auto itModule = _ModuleMap.find(modno);
 	if (itModule == _ModuleMap.end()) return;
 
-	_Hookers[hook]->emplace_back(Hooker{modno, func, itModule->second});
+	_Hookers[hook]->emplace_back(Hooker{modno, func, itModule->second.get()});
 }
 
 void hook_trigger(hook_t hook) {
 	if (hook >= _Hookers.size()) return;
-	for (const auto &hooker : *_Hookers[hook]) {
-		auto module = hooker.module.lock();
-		if (!module) continue;
-		hooker.func(hook, hooker.modno, module->userdata());
+	DispatchScope scope;
+	const auto &  hookers = *_Hookers[hook];
+	for (size_t i = 0; i < hookers.size(); i++) {
+		const Hooker hooker = hookers[i];
+		if (hooker.func) hooker.func(hook, hooker.modno, hooker.module->userdata());
 	}
 }
 
@@ -0,0 +1,102 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "core/workers.hpp"
+
+static thread_local bool _InsideJob = false;
+
+WorkerPool &WorkerPool::Get() {
+	static WorkerPool pool;
+	return pool;
+}
+
+WorkerPool::~WorkerPool() { setup(0); }
+
+void WorkerPool::setup(size_t threads) {
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_condStart.notify_all();
+	for (auto &thread : _threads) thread.join();
+	_threads.clear();
+
+	_stop = false;
+	for (size_t i = 0; i < threads; i++) {
+		_threads.emplace_back(&WorkerPool::_main, this, _job);
+	}
+}
+
+void WorkerPool::_work() {
+	_InsideJob = true;
+	for (size_t i; (i = _next.fetch_add(1)) < _count;) _task(i, _userdata);
+	_InsideJob = false;
+}
+
+void WorkerPool::_main(unsigned long job) {
+	while (1) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_condStart.wait(lock, [&] { return _stop || (_job != job); });
+			if (_stop) break;
+			job = _job;
+		}
+
+		_work();
+
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (--_pending < 1) _condDone.notify_all();
+		}
+	}
+}
+
+void WorkerPool::run(size_t count, worker_task_f task, void *userdata) {
+	// run serially if parallelism would not pay off or the pool is occupied,
+	// e.g. by another animator thread or an enclosing job
+	std::unique_lock<std::mutex> submit(_submitMutex, std::defer_lock);
+	if (
+		(count < 2) || _threads.empty() || _InsideJob || !submit.try_lock()) {
+		for (size_t i = 0; i < count; i++) task(i, userdata);
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_task     = task;
+		_userdata = userdata;
+		_count    = count;
+		_next     = 0;
+		_pending  = _threads.size();
+		_job++;
+	}
+	_condStart.notify_all();
+
+	_work();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_condDone.wait(lock, [&] { return _pending < 1; });
+}
+
+extern "C" {
+
+void workers_run(size_t count, worker_task_f task, void *userdata) {
+	WorkerPool::Get().run(count, task, userdata);
+}
+
+size_t workers_count() { return WorkerPool::Get().size(); }
+}
@@ -0,0 +1,62 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_WORKERS_HPP
+#define CORE_WORKERS_HPP
+
+#include "core/workers_api.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads sharing out index ranges of data-parallel jobs. One job
+// runs at a time, the submitting thread working alongside the pool.
+class WorkerPool {
+protected:
+	std::vector<std::thread> _threads;
+	std::mutex               _mutex;
+	std::mutex               _submitMutex;
+	std::condition_variable  _condStart;
+	std::condition_variable  _condDone;
+
+	worker_task_f       _task     = nullptr;
+	void *              _userdata = nullptr;
+	size_t              _count    = 0;
+	std::atomic<size_t> _next     = 0;
+	size_t              _pending  = 0;
+	unsigned long       _job      = 0;
+	bool                _stop     = false;
+
+	WorkerPool() {}
+	void _work();
+	void _main(unsigned long job);
+
+public:
+	~WorkerPool();
+	static WorkerPool &Get();
+
+	// (re)starts the pool with the given number of threads in addition to the
+	// submitting one. Must not be called while jobs are running.
+	void   setup(size_t threads);
+	size_t size() const { return _threads.size() + 1; }
+
+	void run(size_t count, worker_task_f task, void *userdata);
+};
+
+#endif
@@ -0,0 +1,42 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CORE_WORKERS_API_H
+#define CORE_WORKERS_API_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*worker_task_f)(size_t index, void *userdata);
+
+// calls task(i, userdata) for every i in [0, count) spread across the worker
+// pool, returning once all calls completed. The calling thread participates.
+// Tasks must not depend on the order or thread they are run on. Nested calls
+// and calls made while the pool is busy run serially on the calling thread.
+void workers_run(size_t count, worker_task_f task, void *userdata);
+
+// number of threads taking part in workers_run, including the caller
+size_t workers_count();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+// Measures the cost per blended LED of the fade and wipe mixes: the previous
+// scalar loops, writing through ledv into the frame and (for wipe) projecting
+// every LED's coordinates on each call, against the led_lerp/led_lerp_ramp
+// kernels on dense buffers and geometry from blend_prepare. Both must give
+// the same colours.
+//
+// usage: bench-blend [leds] [iterations]
+
+#include "alpha4c/types/vector.h"
+#include "modules/coordinates_api.h"
+#include "util/kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "alpha4c/common/math.h"
+}
+
+static void _FadeScalar(
+	const led_i_t *ledv, size_t ledn, led_t *accum, const led_t *op2, float t) {
+	const float f = fclamp(1.0f - t);
+	const float g = fclamp(t);
+	for (size_t i = 0; i < ledn; i++) {
+		accum[ledv[i]].r = op2[i].r * f + accum[ledv[i]].r * g;
+		accum[ledv[i]].g = op2[i].g * f + accum[ledv[i]].g * g;
+		accum[ledv[i]].b = op2[i].b * f + accum[ledv[i]].b * g;
+	}
+}
+
+static void _WipeScalar(
+	const led_i_t *         ledv,
+	size_t                  ledn,
+	led_t *                 accum,
+	const led_t *           op2,
+	const led_coord_data_t *coords,
+	const vec3f_t &         direction,
+	float                   d,
+	float                   window) {
+	const float windowInv = 1.0f / window;
+	for (size_t i = 0; i < ledn; i++) {
+		float d1 = vec3f_dot(&coords[ledv[i]].pos, &direction);
+
+		float f = fclamp((d1 - d) * windowInv);
+		float g = 1.0f - f;
+
+		accum[ledv[i]].r = op2[i].r * f + accum[ledv[i]].r * g;
+		accum[ledv[i]].g = op2[i].g * f + accum[ledv[i]].g * g;
+		accum[ledv[i]].b = op2[i].b * f + accum[ledv[i]].b * g;
+	}
+}
+
+static bool _Same(
+	const std::vector<led_t> &  frame,
+	const std::vector<led_t> &  dense,
+	const std::vector<led_i_t> &ledv,
+	const char *                what) {
+	for (size_t i = 0; i < ledv.size(); i++) {
+		const led_t &a = frame[ledv[i]], &b = dense[i];
+		if (
+			std::fabs(a.r - b.r) > 1e-5 || std::fabs(a.g - b.g) > 1e-5
+			|| std::fabs(a.b - b.b) > 1e-5) {
+			fprintf(stderr, "%s: mismatch at led %u\n", what, ledv[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const size_t leds       = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const int    iterations = argc > 2 ? std::atoi(argv[2]) : 500;
+
+	// blend every other LED of a frame laid out in a 3d cube
+	std::mt19937                          rng(2022);
+	std::uniform_real_distribution<float> unit(0, 1);
+	std::vector<led_coord_data_t>         coords(leds);
+	for (auto &c : coords) {
+		c.pos    = {unit(rng) * 100, unit(rng) * 100, unit(rng) * 100};
+		c.normal = {0, 0, 1};
+	}
+	std::vector<led_i_t> ledv;
+	for (size_t i = 0; i < leds; i += 2) ledv.push_back(i);
+	const size_t ledn = ledv.size();
+
+	std::vector<led_t> frame0(leds), op2(ledn);
+	for (auto &l : frame0) l = {unit(rng), unit(rng), unit(rng)};
+	for (auto &l : op2) l = {unit(rng), unit(rng), unit(rng)};
+	std::vector<led_t> dense0(ledn);
+	for (size_t i = 0; i < ledn; i++) dense0[i] = frame0[ledv[i]];
+
+	const vec3f_t direction = {0.6f, 0.8f, 0};
+	const float   d0 = -4, d1 = 140, window = 4;
+
+	using clock = std::chrono::steady_clock;
+	using ns    = std::chrono::duration<double, std::nano>;
+
+	// geometry is prepared once per LED set and cached by mod_display
+	std::vector<float> geometry(ledn);
+	auto               p0 = clock::now();
+	for (size_t i = 0; i < ledn; i++) {
+		geometry[i] = vec3f_dot(&coords[ledv[i]].pos, &direction);
+	}
+	const double prepare = ns(clock::now() - p0).count() / ledn;
+
+	bool   ok      = true;
+	double fadeOld = 0, fadeNew = 0;
+	double wipeOld = 0, wipeNew = 0;
+	for (int k = 0; k < iterations; k++) {
+		const float t = (k % 100) / 99.f;
+		const float d = d0 * fclamp(1.0f - t) + d1 * fclamp(t);
+
+		std::vector<led_t> frame = frame0, dense = dense0;
+		auto               t0    = clock::now();
+		_FadeScalar(ledv.data(), ledn, frame.data(), op2.data(), t);
+		auto t1 = clock::now();
+		led_lerp(dense.data(), op2.data(), fclamp(1.0f - t), ledn);
+		auto t2 = clock::now();
+		fadeOld += ns(t1 - t0).count();
+		fadeNew += ns(t2 - t1).count();
+		if (ok) ok = _Same(frame, dense, ledv, "fade");
+
+		frame = frame0;
+		dense = dense0;
+		t0    = clock::now();
+		_WipeScalar(
+			ledv.data(),
+			ledn,
+			frame.data(),
+			op2.data(),
+			coords.data(),
+			direction,
+			d,
+			window);
+		t1 = clock::now();
+		led_lerp_ramp(
+			dense.data(), op2.data(), geometry.data(), d, 1.0f / window, ledn);
+		t2 = clock::now();
+		wipeOld += ns(t1 - t0).count();
+		wipeNew += ns(t2 - t1).count();
+		if (ok) ok = _Same(frame, dense, ledv, "wipe");
+	}
+	printf("equivalence: %s\n", ok ? "ok" : "FAILED");
+
+	const double per = 1.0 / ((double)iterations * ledn);
+	printf("%zu leds blended, ns per led:\n", ledn);
+	printf(
+		"  fade: scalar %.2f, led_lerp %.2f (%.1fx)\n",
+		fadeOld * per,
+		fadeNew * per,
+		fadeOld / fadeNew);
+	printf(
+		"  wipe: scalar %.2f, led_lerp_ramp %.2f (%.1fx), prepare %.2f once\n",
+		wipeOld * per,
+		wipeNew * per,
+		wipeOld / wipeNew,
+		prepare);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+// Compares a full-frame overlay update, a hex colour for every LED blended
+// over the whole frame, with a sparse update of only the covered LEDs, sent
+// as base64 rgba and blended run by run. Both must give the same frame.
+//
+// usage: bench-overlay [leds] [coverage] [iterations]
+
+#include "util/overlay.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static std::string _EncodeBase64(const std::vector<uint8_t> &data) {
+	const char *alphabet =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string out;
+	for (size_t i = 0; i < data.size(); i += 3) {
+		uint32_t acc = data[i] << 16;
+		if (i + 1 < data.size()) acc |= data[i + 1] << 8;
+		if (i + 2 < data.size()) acc |= data[i + 2];
+		out += alphabet[(acc >> 18) & 63];
+		out += alphabet[(acc >> 12) & 63];
+		out += i + 1 < data.size() ? alphabet[(acc >> 6) & 63] : '=';
+		out += i + 2 < data.size() ? alphabet[acc & 63] : '=';
+	}
+	return out;
+}
+
+static void _Fill(std::vector<led_t> &frame) {
+	for (size_t i = 0; i < frame.size(); i++) {
+		frame[i] = {(i % 7) / 7.f, (i % 11) / 11.f, (i % 13) / 13.f};
+	}
+}
+
+int main(int argc, char **argv) {
+	const size_t leds       = argc > 1 ? std::atoi(argv[1]) : 10000;
+	const double coverage   = argc > 2 ? std::atof(argv[2]) : 0.05;
+	const int    iterations = argc > 3 ? std::atoi(argv[3]) : 200;
+	const size_t covered    = std::min(leds, (size_t)(leds * coverage));
+
+	// full frame: one hex colour per LED, transparent outside the overlay
+	std::string hex;
+	for (size_t i = 0; i < leds; i++) {
+		hex += i < covered ? "ff00ff80 " : "00000000 ";
+	}
+
+	// sparse: base64 rgba of the covered LEDs only
+	std::vector<uint8_t> rgba8;
+	for (size_t i = 0; i < covered; i++) {
+		rgba8.insert(rgba8.end(), {255, 0, 255, 128});
+	}
+	const std::string payload = _EncodeBase64(rgba8);
+
+	std::vector<led_t>  full(leds), sparse(leds);
+	std::vector<leda_t> dense(leds);
+	SparseOverlay       overlay;
+	double              fullUpdate = 0, fullApply = 0;
+	double              sparseUpdate = 0, sparseApply = 0;
+
+	for (int k = 0; k < iterations; k++) {
+		_Fill(full);
+		_Fill(sparse);
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < leds; i++) {
+			SparseOverlay::ParseHex(std::string(hex.data() + i * 9, 8), dense[i]);
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		led_overlay(full.data(), (const float *)(const void *)dense.data(), leds);
+		auto t2 = std::chrono::steady_clock::now();
+
+		std::vector<uint8_t> data;
+		SparseOverlay::DecodeBase64(payload, data);
+		std::vector<leda_t> values(data.size() / 4);
+		for (size_t i = 0; i < values.size(); i++) {
+			values[i] = SparseOverlay::FromRGBA8(data.data() + i * 4);
+		}
+		overlay.clear();
+		overlay.write(0, values.data(), values.size());
+		auto t3 = std::chrono::steady_clock::now();
+		overlay.apply(sparse.data(), 0, leds);
+		auto t4 = std::chrono::steady_clock::now();
+
+		using us = std::chrono::duration<double, std::micro>;
+		fullUpdate += us(t1 - t0).count();
+		fullApply += us(t2 - t1).count();
+		sparseUpdate += us(t3 - t2).count();
+		sparseApply += us(t4 - t3).count();
+	}
+
+	bool ok = true;
+	for (size_t i = 0; i < leds && ok; i++) {
+		ok = std::fabs(full[i].r - sparse[i].r) < 1e-5
+				 && std::fabs(full[i].g - sparse[i].g) < 1e-5
+				 && std::fabs(full[i].b - sparse[i].b) < 1e-5;
+		if (!ok) fprintf(stderr, "mismatch at led %zu\n", i);
+	}
+	printf("equivalence: %s\n", ok ? "ok" : "FAILED");
+
+	printf(
+		"%zu leds, %zu overlaid: full %.1fus update + %.1fus apply, "
+		"sparse %.1fus update + %.1fus apply\n",
+		leds,
+		covered,
+		fullUpdate / iterations,
+		fullApply / iterations,
+		sparseUpdate / iterations,
+		sparseApply / iterations);
+
+	return ok ? 0 : 1;
+}
@@ -24,11 +24,14 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/basemodule.hpp"
 #include "core/egress.hpp"
 #include "core/egress_api.h"
+#include "core/filter.hpp"
 #include "core/frame.hpp"
 #include "core/frame_api.h"
+#include "core/framequeue.hpp"
 #include "core/ledset.hpp"
 #include "core/module.hpp"
 #include "core/module_api.h"
+#include "core/workers.hpp"
 #include "modules/coordinates_api.h"
 #include "util/sync.hpp"
 #include <chrono>
@@ -56,6 +59,11 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 
 static size_t _ThreadCount = 0;
 static double _FPSTarget   = 60.0;
+static size_t _RenderAhead = 0;
+
+// held while presenting a frame to egress in render-ahead mode, as well as
+// while processing commands, which may reconfigure egress and filters
+static std::mutex _SyncMutex;
 
 static void handle_sigint(int) { main_stop(); }
 
@@ -69,6 +77,85 @@ static void             _AnimThread(size_t iAnimator) {
   }
 }
 
+static void _PresentThread(hook_t hook_applyFilter) {
+	using namespace std::chrono_literals;
+	Drummer            drummer(1s / _FPSTarget);
+	auto &             queue = FrameQueue::Get();
+	std::vector<led_t> frame;
+	while (_Running) {
+		drummer.sync();
+		std::unique_lock<std::mutex> lock(_SyncMutex);
+		FrameQueue::time_point       tTarget;
+		if (!queue.pop(
+					frame,
+					frame_size(),
+					std::chrono::time_point_cast<FrameQueue::duration>(
+						FrameQueue::clock::now()),
+					tTarget)) {
+			continue;
+		}
+		Frame::PresentEgress(frame, tTarget.time_since_epoch().count());
+		FilterPipeline::Get().apply();
+		hook_trigger(hook_applyFilter);
+		EgressInstance::Flush();
+	}
+}
+
+// renders frames ahead of time into the frame queue, which a separate thread
+// presents on schedule
+static void _OrchestrateAhead(hook_t hook_applyFilter) {
+	using namespace std::chrono_literals;
+	FPSCounter fpsCounter;
+
+	auto &barrier  = AnimBarrier::Get();
+	auto &animPool = AnimatorPool::Get();
+	auto &queue    = FrameQueue::Get();
+
+	queue.setup(
+		_RenderAhead,
+		std::chrono::duration_cast<FrameQueue::duration>(1s / _FPSTarget));
+
+	_Running = true;
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < _ThreadCount; i++) {
+		threads.emplace_back(_AnimThread, i);
+	}
+	if (_ThreadCount > 0) barrier.waitForAnimators(_ThreadCount);
+	std::thread presenter(_PresentThread, hook_applyFilter);
+
+	FrameQueue::time_point tTarget;
+	while (main_running() && queue.reserve(tTarget)) {
+		{
+			std::unique_lock<std::mutex> lock(_SyncMutex);
+			Frame::FlushPreanim();
+			Module::Flush();
+			animPool.flush();
+			Frame::FlushAnim();
+		}
+
+		const auto tRendered = std::chrono::time_point_cast<FrameQueue::duration>(
+			FrameQueue::clock::now());
+		animPool.beginFrame(tTarget);
+		if (_ThreadCount < 1) {
+			animPool.renderFrame(0);
+		} else {
+			barrier.startFrame();
+			barrier.waitForAnimators(_ThreadCount);
+		}
+		queue.push(frame_raw_anim(), frame_size(), tTarget, tRendered);
+		fpsCounter.iterate();
+	}
+
+	_Running = false;
+	queue.stop();
+	presenter.join();
+	if (_ThreadCount > 0) barrier.startFrame();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	queue.setup(0, FrameQueue::duration(0));
+}
+
 void orchestrate() {
 	using namespace std::chrono_literals;
 	Drummer    drummer(1s / _FPSTarget);
@@ -78,6 +165,7 @@ void orchestrate() {
 	auto & animPool = AnimatorPool::Get();
 	size_t iframe   = 0;
 
+	animPool.setFramePeriod(AnimatorPool::duration(1.0 / _FPSTarget));
 	Module::Flush();
 	animPool.flush();
 	Frame::FlushAnim();
@@ -87,10 +175,13 @@ void orchestrate() {
 	{
 		signal(SIGINT, handle_sigint);
 		alp::Guard guard1([] { signal(SIGINT, nullptr); });
-		if (_ThreadCount < 1) {
+		if (_RenderAhead > 0) {
+			_OrchestrateAhead(hook_applyFilter);
+		} else if (_ThreadCount < 1) {
 			while (main_running()) {
 				iframe++;
 				Frame::FlushEgress();
+				FilterPipeline::Get().apply();
 				hook_trigger(hook_applyFilter);
 				EgressInstance::Flush();
 				Module::Flush();
@@ -100,6 +191,7 @@ void orchestrate() {
 				drummer.sync();
 				fpsCounter.iterate();
 
+				animPool.beginFrame();
 				animPool.renderFrame(0);
 			}
 		} else {
@@ -115,6 +207,7 @@ void orchestrate() {
 
 				barrier.waitForAnimators(_ThreadCount);
 				Frame::FlushEgress();
+				FilterPipeline::Get().apply();
 				hook_trigger(hook_applyFilter);
 				EgressInstance::Flush();
 				Module::Flush();
@@ -124,6 +217,7 @@ void orchestrate() {
 				drummer.sync();
 				fpsCounter.iterate();
 
+				animPool.beginFrame();
 				barrier.startFrame();
 			}
 
@@ -195,6 +289,19 @@ alp::CLI cli{
 		 "animation",
 		 [](const size_t &n) { _ThreadCount = n; }},
 
+		{'w',
+		 "worker-count",
+		 "set the number of worker threads available to animations and filters "
+		 "for data-parallel work, default: 0",
+		 [](const size_t &n) { WorkerPool::Get().setup(n); }},
+
+		{'a',
+		 "render-ahead",
+		 "render up to this many frames ahead of egress, adding as many frame "
+		 "periods of output latency in exchange for absorbing slow frames, "
+		 "default: 0",
+		 [](const size_t &n) { _RenderAhead = n; }},
+
 		{'r',
 		 "frame-rate",
 		 "set the target frame rate to achieve, default: 60 Hz",
@@ -237,6 +344,7 @@ int main(int argn, char **argv) {
 	egress_cleanup();
 	AnimatorPool::Get().clear();
 	AnimatorPool::Get().setup(0);
+	WorkerPool::Get().setup(0);
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Checks bytes_interleave and the striping built on it against the bytewise
+// striping loop it replaced, and measures their throughput. Built once per
+// instruction set (scalar, SSE2, AVX2), so this only uses integer arithmetic.
+
+#include "util/interleave.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using Strands = std::vector<std::vector<uint8_t>>;
+
+// the previous striping loop: round by round, one byte of each strand that is
+// long enough
+static void _StripeBytewise(const Strands &strands, uint8_t *out) {
+	size_t total = 0;
+	for (const auto &strand : strands) total += strand.size();
+	size_t round = 0;
+	for (uint8_t *p = out, *e = out + total; p < e; round++) {
+		for (const auto &strand : strands) {
+			if (strand.size() <= round) continue;
+			*p++ = strand[round];
+		}
+	}
+}
+
+// striping as done by egress_upsilon-striped: the range covered by all
+// strands is interleaved at once, the rest round by round
+static void _Stripe(
+	const Strands &strands, std::vector<const uint8_t *> &rows, uint8_t *out) {
+	size_t common = SIZE_MAX, total = 0;
+	rows.clear();
+	for (const auto &strand : strands) {
+		rows.push_back(strand.data());
+		common = std::min(common, strand.size());
+		total += strand.size();
+	}
+	bytes_interleave(out, rows.data(), rows.size(), common);
+
+	size_t round = common;
+	for (uint8_t *p = out + common * strands.size(), *e = out + total; p < e;) {
+		for (const auto &strand : strands) {
+			if (strand.size() <= round) continue;
+			*p++ = strand[round];
+		}
+		round++;
+	}
+}
+
+static Strands _RandomStrands(std::mt19937 &rng, size_t count, size_t length) {
+	Strands strands(count);
+	for (auto &strand : strands) {
+		strand.resize(length > 0 ? length : rng() % 200);
+		for (auto &b : strand) b = rng();
+	}
+	return strands;
+}
+
+int main() {
+#ifdef __AVX2__
+	const char *isa = "avx2";
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("avx2")) {
+		printf("avx2 not supported by this cpu, skipping\n");
+		return 77;
+	}
+#elif defined(__SSE2__)
+	const char *isa = "sse2";
+#else
+	const char *isa = "scalar";
+#endif
+
+	std::mt19937                 rng(2022);
+	std::vector<const uint8_t *> rows;
+	bool                         ok = true;
+
+	// 8 and 16 strands take the vector paths, other counts the scalar loop;
+	// equal lengths are interleaved completely, ragged ones partly
+	for (int k = 0; k < 5000; k++) {
+		const size_t count = (k % 3 == 0) ? 8 : (k % 3 == 1) ? 16 : 1 + rng() % 20;
+		const size_t length = (k % 2) ? 1 + rng() % 200 : 0;
+		Strands      strands = _RandomStrands(rng, count, length);
+		size_t       total   = 0;
+		for (const auto &strand : strands) total += strand.size();
+
+		std::vector<uint8_t> expected(total), actual(total);
+		_StripeBytewise(strands, expected.data());
+		_Stripe(strands, rows, actual.data());
+		if (actual != expected) {
+			if (ok) fprintf(stderr, "mismatch: %zu strands, layout %d\n", count, k);
+			ok = false;
+		}
+	}
+	printf("equivalence (%s): %s\n", isa, ok ? "ok" : "FAILED");
+
+	// strands of 1000 upsilon2 pixels, 13 bytes each
+	for (size_t count : {8, 16}) {
+		Strands              strands = _RandomStrands(rng, count, 13000);
+		std::vector<uint8_t> out(count * 13000);
+
+		auto bench = [&](auto stripe) {
+			const int iterations = 500;
+			auto      t0         = std::chrono::steady_clock::now();
+			for (int i = 0; i < iterations; i++) stripe();
+			auto t1 = std::chrono::steady_clock::now();
+			const long long ns =
+				std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+			// bytes per ns = GB/s, in hundredths
+			return (long long)(out.size() * iterations * 100) / std::max(ns, 1ll);
+		};
+		const long long bytewise =
+			bench([&] { _StripeBytewise(strands, out.data()); });
+		const long long interleaved =
+			bench([&] { _Stripe(strands, rows, out.data()); });
+		printf(
+			"%zu strands (%s): bytewise %lld.%02lld GB/s, interleaved %lld.%02lld "
+			"GB/s\n",
+			count,
+			isa,
+			bytewise / 100,
+			bytewise % 100,
+			interleaved / 100,
+			interleaved % 100);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Checks the table-driven UARTEncoder against the bitwise encoder it replaced
+// and compares their speed. Only 8N1 framing exists, so there are no other
+// parity or stop bit modes to cover.
+
+#include "util/uart.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// the previous encoder, shifting every bit through a byte
+struct BitwiseUARTEncoder {
+	uint8_t *&ptr;
+	uint8_t   currentByte = 0;
+	int       counter     = 0;
+
+	BitwiseUARTEncoder(uint8_t *&ptr) : ptr(ptr) {}
+
+	inline void addBit(int v) {
+		currentByte = (currentByte << 1) | (v & 1);
+		if (++counter == 8) {
+			*ptr++      = currentByte;
+			currentByte = 0;
+			counter     = 0;
+		}
+	}
+
+	inline void flush() {
+		while (counter != 0) addBit(1);
+	}
+	inline void addFrame(uint8_t data) {
+		addBit(0);
+		for (int i = 0; i < 8; i++) addBit(data >> i);
+		addBit(1);
+	}
+
+	inline void addIdle(size_t duration) {
+		for (size_t i = 0; i < duration; i++) addBit(1);
+	}
+};
+
+// encoder operation: frame (data), idle run (length) or flush
+struct Op {
+	enum { Frame, Idle, Flush } kind;
+	unsigned value;
+};
+
+template <typename Encoder>
+static std::vector<uint8_t> _Encode(const std::vector<Op> &ops) {
+	std::vector<uint8_t> out(ops.size() * 16 + 64, 0xa5);
+	uint8_t *            ptr = out.data();
+	{
+		Encoder enc(ptr);
+		for (const auto &op : ops) {
+			switch (op.kind) {
+			case Op::Frame: enc.addFrame(op.value); break;
+			case Op::Idle: enc.addIdle(op.value); break;
+			case Op::Flush: enc.flush(); break;
+			}
+		}
+	}
+	out.resize(ptr - out.data());
+	return out;
+}
+
+static bool _Check(const std::vector<Op> &ops, const char *what) {
+	if (_Encode<UARTEncoder>(ops) == _Encode<BitwiseUARTEncoder>(ops)) {
+		return true;
+	}
+	static int reported = 0;
+	if (reported++ < 8) fprintf(stderr, "mismatch: %s\n", what);
+	return false;
+}
+
+int main() {
+	bool ok = true;
+
+	for (unsigned a = 0; a < 256; a++) {
+		ok &= _Check({{Op::Frame, a}, {Op::Flush, 0}}, "single byte");
+		for (unsigned b = 0; b < 256; b++) {
+			ok &= _Check(
+				{{Op::Frame, a}, {Op::Frame, b}, {Op::Flush, 0}}, "byte pair");
+		}
+	}
+
+	std::mt19937 rng(2022);
+	for (int k = 0; k < 20000; k++) {
+		std::vector<Op> ops(rng() % 64);
+		for (auto &op : ops) {
+			switch (rng() % 8) {
+			case 0: op = {Op::Idle, (unsigned)(rng() % 80)}; break;
+			case 1: op = {Op::Flush, 0}; break;
+			default: op = {Op::Frame, (unsigned)(rng() % 256)}; break;
+			}
+		}
+		if (rng() % 2) ops.push_back({Op::Flush, 0});
+		ok &= _Check(ops, "random sequence");
+	}
+	printf("equivalence: %s\n", ok ? "ok" : "FAILED");
+
+	// one upsilon2 strand of 1000 pixels: 3 frames per pixel and some idle time
+	// between pixels, as the egress encodes it
+	std::vector<Op> strand;
+	for (int i = 0; i < 1000; i++) {
+		for (int c = 0; c < 3; c++) {
+			strand.push_back({Op::Frame, (unsigned)(rng() % 256)});
+		}
+		strand.push_back({Op::Idle, 4});
+	}
+	strand.push_back({Op::Flush, 0});
+
+	auto bench = [&](auto encode) {
+		const int       iterations = 2000;
+		volatile size_t sink       = 0;
+		auto            t0         = std::chrono::steady_clock::now();
+		for (int i = 0; i < iterations; i++) sink = sink + encode(strand).size();
+		auto t1 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::micro>(t1 - t0).count()
+					 / iterations;
+	};
+	const double bitwise = bench(_Encode<BitwiseUARTEncoder>);
+	const double table   = bench(_Encode<UARTEncoder>);
+	printf(
+		"1000 pixel strand: bitwise %.1fus, table %.1fus (%.1fx)\n",
+		bitwise,
+		table,
+		bitwise / table);
+
+	return ok ? 0 : 1;
+}
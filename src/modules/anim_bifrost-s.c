@@ -30,6 +30,8 @@ typedef struct ud_t {
 	float fx, fy, fz;
 } ud_t;
 
+const unsigned Flags = ANIMATION_PURE;
+
 void init(const led_i_t *, size_t, const char *argstr, ud_t **pud) {
 	*pud                    = (ud_t *)malloc(sizeof(ud_t));
 	(**pud).fixed_hue       = 0;
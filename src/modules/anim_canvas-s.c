@@ -0,0 +1,247 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "alpha4c/types/vector.h"
+#include "anim_common.h"
+#include "modules/canvas_api.h"
+#include "modules/coordinates_api.h"
+
+// Samples a mod_canvas canvas through a projection of each LED's coordinates.
+// Canvas coordinates (u, v) run from 0 to 1 left to right and bottom to top;
+// they are computed once per LED whenever LEDs or coordinates change.
+
+typedef enum projection_t {
+	PLANAR,
+	CYLINDRICAL,
+	SPHERICAL,
+} projection_t;
+
+typedef struct ud_t {
+	char *       canvas;
+	projection_t projection;
+	int          axes[3]; // u axis, v axis, projection axis
+	float        origin[3];
+	float        size[2];
+	float        scroll[2];
+	int          wrap;
+
+	size_t   ledn;
+	led_i_t *ledv;
+	float *  uv;
+	uint32_t version;
+} ud_t;
+
+#define INV_TAU (1.0f / 6.28318530f)
+
+static int _axis(char c) { return c == 'x' ? 0 : (c == 'y' ? 1 : 2); }
+
+void init(const led_i_t *, size_t, const char *argstr, ud_t **pud) {
+	ud_t *ud       = (ud_t *)calloc(1, sizeof(ud_t));
+	*pud           = ud;
+	ud->projection = PLANAR;
+	ud->axes[0]    = 0;
+	ud->axes[1]    = 1;
+	ud->axes[2]    = 2;
+	ud->size[0]    = 1;
+	ud->size[1]    = 1;
+
+	lscan_t *ln = lscan_new(argstr, 0);
+
+	while (!lscan_eof(ln)) {
+		char *cmd = lscan_str(ln, LSCAN_MANY, 0);
+		if (0 == cmd) break;
+
+		if (strcmp(cmd, "canvas") == 0) {
+			free(ud->canvas);
+			ud->canvas = lscan_str(ln, LSCAN_MANY, 0);
+		} else if (strcmp(cmd, "projection") == 0) {
+			char *value = lscan_str(ln, LSCAN_MANY, 0);
+			if (value) {
+				if (strcmp(value, "cylindrical") == 0) {
+					ud->projection = CYLINDRICAL;
+				} else if (strcmp(value, "spherical") == 0) {
+					ud->projection = SPHERICAL;
+				} else {
+					ud->projection = PLANAR;
+				}
+				free(value);
+			}
+		} else if (strcmp(cmd, "plane") == 0) {
+			char *value = lscan_str(ln, LSCAN_MANY, 0);
+			if (value && strlen(value) == 2 && value[0] != value[1]) {
+				ud->axes[0] = _axis(value[0]);
+				ud->axes[1] = _axis(value[1]);
+				ud->axes[2] = 3 - ud->axes[0] - ud->axes[1];
+			}
+			free(value);
+		} else if (strcmp(cmd, "origin") == 0) {
+			lscan_float(ln, &ud->origin[0], LSCAN_MANY);
+			lscan_float(ln, &ud->origin[1], LSCAN_MANY);
+			lscan_float(ln, &ud->origin[2], LSCAN_MANY);
+		} else if (strcmp(cmd, "size") == 0) {
+			lscan_float(ln, &ud->size[0], LSCAN_MANY);
+			lscan_float(ln, &ud->size[1], LSCAN_MANY);
+		} else if (strcmp(cmd, "scroll") == 0) {
+			lscan_float(ln, &ud->scroll[0], LSCAN_MANY);
+			lscan_float(ln, &ud->scroll[1], LSCAN_MANY);
+		} else if (strcmp(cmd, "wrap") == 0) {
+			ud->wrap = 1;
+		}
+
+		free(cmd);
+	}
+	lscan_free(ln);
+
+	if (!ud->canvas) ud->canvas = strdup("default");
+	if (ud->size[0] == 0) ud->size[0] = 1;
+	if (ud->size[1] == 0) ud->size[1] = 1;
+}
+
+void deinit(ud_t *ud) {
+	free(ud->canvas);
+	free(ud->ledv);
+	free(ud->uv);
+	free((void *)ud);
+}
+
+static void _project(ud_t *ud, const vec3f_t *pos, float *uv) {
+	const float p[3] = {
+		pos->x - ud->origin[0], pos->y - ud->origin[1], pos->z - ud->origin[2]};
+	const float a = p[ud->axes[0]], b = p[ud->axes[1]], c = p[ud->axes[2]];
+
+	switch (ud->projection) {
+		case PLANAR:
+			uv[0] = a / ud->size[0];
+			uv[1] = b / ud->size[1];
+			break;
+		case CYLINDRICAL:
+			uv[0] = atan2f(b, a) * INV_TAU + 0.5f;
+			uv[1] = c / ud->size[1];
+			break;
+		case SPHERICAL: {
+			const float r = sqrtf(a * a + b * b + c * c);
+			uv[0]         = atan2f(b, a) * INV_TAU + 0.5f;
+			uv[1]         = r > 0 ? asinf(c / r) * 2 * INV_TAU + 0.5f : 0.5f;
+		} break;
+	}
+}
+
+static void _updateMapping(const led_i_t *ledv, size_t ledn, ud_t *ud) {
+	const uint32_t version = coordinates_version();
+	if (
+		(ud->version == version) && (ud->ledn == ledn)
+		&& (ledn < 1 || memcmp(ud->ledv, ledv, ledn * sizeof(led_i_t)) == 0)) {
+		return;
+	}
+
+	ud->version = version;
+	ud->ledn    = ledn;
+	ud->ledv    = (led_i_t *)realloc(ud->ledv, ledn * sizeof(led_i_t));
+	ud->uv      = (float *)realloc(ud->uv, ledn * 2 * sizeof(float));
+	if (ledn > 0) memcpy(ud->ledv, ledv, ledn * sizeof(led_i_t));
+
+	const led_coord_data_t *coords = coordinates_raw_anim();
+	for (size_t i = 0; i < ledn; i++) {
+		_project(ud, &coords[ledv[i]].pos, ud->uv + i * 2);
+	}
+}
+
+// resolves a texel coordinate to the two neighbouring texels and the weight
+// of the second one
+static void _texels(float f, long n, int wrap, long *i0, long *i1, float *w) {
+	const float fl = floorf(f);
+	*w             = f - fl;
+	*i0            = (long)fl;
+	*i1            = *i0 + 1;
+	if (wrap) {
+		*i0 = ((*i0 % n) + n) % n;
+		*i1 = ((*i1 % n) + n) % n;
+	} else {
+		*i0 = *i0 < 0 ? 0 : (*i0 >= n ? n - 1 : *i0);
+		*i1 = *i1 < 0 ? 0 : (*i1 >= n ? n - 1 : *i1);
+	}
+}
+
+void iterate(
+	const led_i_t *ledv, size_t ledn, ud_t *ud, frame_time_t, frame_time_t t) {
+	led_t *         leds   = frame_raw_anim();
+	const canvas_t *canvas = canvas_get(ud->canvas);
+
+	if (!canvas || canvas->width < 1 || canvas->height < 1) {
+		for (size_t i = 0; i < ledn; i++) {
+			leds[ledv[i]].r = leds[ledv[i]].g = leds[ledv[i]].b = 0;
+		}
+		return;
+	}
+
+	_updateMapping(ledv, ledn, ud);
+
+	const long   w     = canvas->width;
+	const long   h     = canvas->height;
+	const int    wrapU = ud->wrap || ud->projection != PLANAR;
+	const float  du    = fmodf(ud->scroll[0] * t, 1.0f);
+	const float  dv    = fmodf(ud->scroll[1] * t, 1.0f);
+	const led_t *px    = canvas->pixels;
+
+	for (size_t i = 0; i < ledn; i++) {
+		const float *uv = ud->uv + i * 2;
+		long         x0, x1, y0, y1;
+		float        wx, wy;
+		_texels((uv[0] + du) * w - 0.5f, w, wrapU, &x0, &x1, &wx);
+		_texels((1 - (uv[1] + dv)) * h - 0.5f, h, ud->wrap, &y0, &y1, &wy);
+
+		const led_t *p00 = px + y0 * w + x0, *p01 = px + y0 * w + x1;
+		const led_t *p10 = px + y1 * w + x0, *p11 = px + y1 * w + x1;
+		led_t *      led = leds + ledv[i];
+
+		const float w00 = (1 - wx) * (1 - wy), w01 = wx * (1 - wy);
+		const float w10 = (1 - wx) * wy, w11 = wx * wy;
+		led->r = p00->r * w00 + p01->r * w01 + p10->r * w10 + p11->r * w11;
+		led->g = p00->g * w00 + p01->g * w01 + p10->g * w10 + p11->g * w11;
+		led->b = p00->b * w00 + p01->b * w01 + p10->b * w10 + p11->b * w11;
+	}
+}
+
+uidl_node_t *describe() {
+#define F uidl_float(0, 0, 0, 0)
+	uidl_node_t *projection = uidl_keyword(
+		0,
+		3,
+		uidl_pair("planar", 0),
+		uidl_pair("cylindrical", 0),
+		uidl_pair("spherical", 0));
+	uidl_node_t *plane = uidl_keyword(
+		0,
+		6,
+		uidl_pair("xy", 0),
+		uidl_pair("xz", 0),
+		uidl_pair("yx", 0),
+		uidl_pair("yz", 0),
+		uidl_pair("zx", 0),
+		uidl_pair("zy", 0));
+	return uidl_keyword(
+		0,
+		7,
+		uidl_pair("canvas", uidl_string(0, 0)),
+		uidl_pair("projection", projection),
+		uidl_pair("plane", plane),
+		uidl_pair("origin", uidl_sequence(0, 3, F, F, F)),
+		uidl_pair("size", uidl_sequence(0, 2, F, F)),
+		uidl_pair("scroll", uidl_sequence(0, 2, F, F)),
+		uidl_pair("wrap", 0));
+#undef F
+}
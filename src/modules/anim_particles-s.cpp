@@ -0,0 +1,299 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "alpha4/common/linescanner.hpp"
+#include "alpha4/common/logger.hpp"
+#include "core/workers_api.h"
+#include "util/spatial.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+extern "C" {
+#include "anim_common.h"
+#include "unicorn/idl.h"
+}
+
+// Particles live in world space and are splatted onto all LEDs within their
+// radius, found via a grid over the animated LEDs' coordinates. Integration
+// and splatting are split into chunks run on the worker pool; each splat
+// chunk accumulates into its own buffer, summed up when writing the frame.
+
+struct Emitter {
+	float pos[3];
+	float vel[3];
+};
+
+struct Particle {
+	float pos[3];
+	float vel[3];
+	float age;
+	float life;
+};
+
+struct Particles {
+	std::vector<Emitter> emitters;
+	float                gravity[3] = {0, 0, -1};
+	float                color[3]   = {1, 0.5f, 0.1f};
+	float                radius     = 0.05f;
+	float                lifetime   = 2;
+	float                rate       = 200;
+	float                spread     = 0.3f;
+	float                drag       = 0;
+	size_t               max        = 4096;
+
+	std::vector<Particle> particles;
+	std::vector<float>    spawnCarry;
+	std::mt19937          rng{std::random_device{}()};
+
+	// grid over the LEDs passed to iterate, indexed densely like ledv
+	SpatialGrid          grid;
+	std::vector<led_i_t> gridLEDs;
+	uint32_t             gridVersion = 0;
+	std::vector<float>   positions;
+
+	// per-frame state shared with the worker tasks
+	size_t                          chunkCount = 0;
+	std::vector<std::vector<float>> accum;
+	float                           dt   = 0;
+	const led_i_t *                 ledv = nullptr;
+	size_t                          ledn = 0;
+	// resolved on the rendering thread, as the anim frame may be redirected
+	// per thread (e.g. to a scratch buffer)
+	led_t *leds = nullptr;
+
+	void updateGrid(const led_i_t *ledv, size_t ledn) {
+		const uint32_t version = coordinates_version();
+		if (
+			(version == gridVersion) && (ledn == gridLEDs.size())
+			&& (ledn < 1
+					|| std::memcmp(ledv, gridLEDs.data(), ledn * sizeof(led_i_t)) == 0)) {
+			return;
+		}
+		gridVersion = version;
+		gridLEDs.assign(ledv, ledv + ledn);
+
+		const led_coord_data_t *coords = coordinates_raw_anim();
+		positions.resize(ledn * 3);
+		for (size_t i = 0; i < ledn; i++) {
+			const coord_t &p     = coords[ledv[i]].pos;
+			positions[i * 3 + 0] = p.x;
+			positions[i * 3 + 1] = p.y;
+			positions[i * 3 + 2] = p.z;
+		}
+		grid.build(positions.data(), ledn, 3);
+	}
+
+	void spawn(frame_time_t dt) {
+		spawnCarry.resize(emitters.size(), 0);
+		std::uniform_real_distribution<float> jitter(-1, 1);
+		std::uniform_real_distribution<float> lifeJitter(0.75f, 1.25f);
+		for (size_t e = 0; e < emitters.size(); e++) {
+			spawnCarry[e] += rate * dt;
+			for (; spawnCarry[e] >= 1; spawnCarry[e] -= 1) {
+				if (particles.size() >= max) {
+					spawnCarry[e] = 0;
+					break;
+				}
+				const Emitter &em = emitters[e];
+				Particle       p;
+				for (int a = 0; a < 3; a++) {
+					p.pos[a] = em.pos[a];
+					p.vel[a] = em.vel[a] + jitter(rng) * spread;
+				}
+				p.age  = 0;
+				p.life = lifetime * lifeJitter(rng);
+				particles.push_back(p);
+			}
+		}
+	}
+
+	static float dot(const float *d) {
+		return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+	}
+
+	std::pair<size_t, size_t> chunk(size_t index, size_t n) const {
+		return {n * index / chunkCount, n * (index + 1) / chunkCount};
+	}
+
+	static void Integrate(size_t index, void *userdata) {
+		auto &self          = *(Particles *)userdata;
+		auto [i0, i1]       = self.chunk(index, self.particles.size());
+		const float dt      = self.dt;
+		const float damping = std::max(0.0f, 1 - self.drag * dt);
+		for (size_t i = i0; i < i1; i++) {
+			Particle &p = self.particles[i];
+			for (int a = 0; a < 3; a++) {
+				p.vel[a] = (p.vel[a] + self.gravity[a] * dt) * damping;
+				p.pos[a] += p.vel[a] * dt;
+			}
+			p.age += dt;
+		}
+	}
+
+	static void Splat(size_t index, void *userdata) {
+		auto &self    = *(Particles *)userdata;
+		auto [i0, i1] = self.chunk(index, self.particles.size());
+		auto &accum   = self.accum[index];
+		accum.assign(self.ledn * 3, 0);
+
+		const float                       r    = self.radius;
+		const float                       rInv = 1.0f / r;
+		const float *                     pos  = self.positions.data();
+		std::vector<SpatialGrid::index_t> found;
+		for (size_t i = i0; i < i1; i++) {
+			const Particle &p    = self.particles[i];
+			const float     fade = 1 - p.age / p.life;
+			found.clear();
+			self.grid.sphere(p.pos, r, found);
+			for (auto j : found) {
+				const float *q    = pos + j * 3;
+				float        d[3] = {q[0] - p.pos[0], q[1] - p.pos[1], q[2] - p.pos[2]};
+				float        w    = 1 - std::sqrt(dot(d)) * rInv;
+				w *= w * fade;
+				accum[j * 3 + 0] += self.color[0] * w;
+				accum[j * 3 + 1] += self.color[1] * w;
+				accum[j * 3 + 2] += self.color[2] * w;
+			}
+		}
+	}
+
+	static void Resolve(size_t index, void *userdata) {
+		auto &self    = *(Particles *)userdata;
+		auto [i0, i1] = self.chunk(index, self.ledn);
+		led_t *leds   = self.leds;
+		for (size_t i = i0; i < i1; i++) {
+			float c[3] = {0, 0, 0};
+			for (const auto &accum : self.accum) {
+				c[0] += accum[i * 3 + 0];
+				c[1] += accum[i * 3 + 1];
+				c[2] += accum[i * 3 + 2];
+			}
+			led_t *led = leds + self.ledv[i];
+			led->r     = std::min(c[0], 1.0f);
+			led->g     = std::min(c[1], 1.0f);
+			led->b     = std::min(c[2], 1.0f);
+		}
+	}
+
+	void iterate(const led_i_t *ledv, size_t ledn, frame_time_t dt) {
+		updateGrid(ledv, ledn);
+		this->dt   = std::min<frame_time_t>(dt, 0.1);
+		this->ledv = ledv;
+		this->ledn = ledn;
+		this->leds = frame_raw_anim();
+
+		spawn(this->dt);
+
+		// a few chunks per worker to even out uneven particle density
+		chunkCount = std::max<size_t>(
+			1, std::min(workers_count() * 4, particles.size() / 256 + 1));
+		workers_run(chunkCount, Integrate, this);
+
+		particles.erase(
+			std::remove_if(
+				particles.begin(),
+				particles.end(),
+				[](const Particle &p) { return p.age >= p.life; }),
+			particles.end());
+
+		// one accumulation buffer per splat chunk, so keep these few
+		chunkCount = std::max<size_t>(
+			1, std::min(workers_count(), particles.size() / 256 + 1));
+		accum.resize(chunkCount);
+		workers_run(chunkCount, Splat, this);
+		workers_run(chunkCount, Resolve, this);
+	}
+};
+
+extern "C" {
+
+void init(const led_i_t *, size_t, const char *argstr, void **pud) {
+	auto *ud = new Particles();
+	*pud     = ud;
+
+	alp::LineScanner ln(argstr);
+	std::string      cmd;
+	while (ln.get(cmd)) {
+		if (cmd == "emitter") {
+			Emitter em;
+			if (!ln.getAll(
+						em.pos[0],
+						em.pos[1],
+						em.pos[2],
+						em.vel[0],
+						em.vel[1],
+						em.vel[2])) {
+				LOG(W) << "particles: incomplete emitter" << alp::over;
+				break;
+			}
+			ud->emitters.push_back(em);
+		} else if (cmd == "gravity") {
+			ln.getAll(ud->gravity[0], ud->gravity[1], ud->gravity[2]);
+		} else if (cmd == "color") {
+			ln.getAll(ud->color[0], ud->color[1], ud->color[2]);
+		} else if (cmd == "radius") {
+			ln.get(ud->radius);
+		} else if (cmd == "lifetime") {
+			ln.get(ud->lifetime);
+		} else if (cmd == "rate") {
+			ln.get(ud->rate);
+		} else if (cmd == "spread") {
+			ln.get(ud->spread);
+		} else if (cmd == "drag") {
+			ln.get(ud->drag);
+		} else if (cmd == "max") {
+			ln.get(ud->max);
+		} else {
+			LOG(W) << "particles: ignoring unknown argument '" << cmd << "'"
+						 << alp::over;
+		}
+	}
+
+	if (ud->emitters.empty()) ud->emitters.push_back({{0, 0, 0}, {0, 0, 1}});
+	if (!(ud->radius > 0)) ud->radius = 0.05f;
+	if (!(ud->lifetime > 0)) ud->lifetime = 2;
+	ud->particles.reserve(ud->max);
+}
+
+void deinit(void *ud) { delete (Particles *)ud; }
+
+void iterate(
+	const led_i_t *ledv, size_t ledn, void *ud, frame_time_t dt, frame_time_t) {
+	((Particles *)ud)->iterate(ledv, ledn, dt);
+}
+
+uidl_node_t *describe() {
+#define F uidl_float(0, 0, 0, 0)
+	return uidl_keyword(
+		0,
+		9,
+		uidl_pair("emitter", uidl_sequence(0, 6, F, F, F, F, F, F)),
+		uidl_pair("gravity", uidl_sequence(0, 3, F, F, F)),
+		uidl_pair("color", uidl_sequence(0, 3, F, F, F)),
+		uidl_pair("radius", F),
+		uidl_pair("lifetime", F),
+		uidl_pair("rate", F),
+		uidl_pair("spread", F),
+		uidl_pair("drag", F),
+		uidl_pair("max", uidl_integer(0, UIDL_LIMIT_LOWER, 0, 0)));
+#undef F
+}
+}
@@ -28,6 +28,8 @@ typedef struct ud_t {
 
 } ud_t;
 
+const unsigned Flags = ANIMATION_PURE;
+
 void init(const led_i_t *, size_t, const char *argstr, ud_t **pud) {
 	*pud            = (ud_t *)malloc(sizeof(ud_t));
 	(**pud).reverse = 0;
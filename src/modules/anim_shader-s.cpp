@@ -0,0 +1,588 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "alpha4/common/logger.hpp"
+#include "util/module.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+extern "C" {
+#include "anim_common.h"
+#include "unicorn/idl.h"
+}
+
+// Evaluates a user-supplied per-LED expression, e.g.
+//
+//   display shader-s h = t*0.1 + pos.x; hsv(h, 1, sin(t + pos.y)) on all
+//
+// A program is a sequence of `name = expression` statements separated by ';'
+// followed by the output: rgb(r, g, b), hsv(h, s, v) (hue in turns) or a
+// scalar brightness. Inputs are t, i (LED index), pos.x/y/z, normal.x/y/z and
+// the constants pi and tau.
+//
+// Programs compile to register bytecode operating on batches of LANES LEDs.
+// Constant subexpressions are folded at compile time and subexpressions only
+// depending on t are evaluated once per frame. There are no loops, so
+// evaluation cost is bounded by the instruction limit; additionally a frame's
+// evaluation stops once its time budget is spent, continuing with the
+// remaining LEDs in the next frame.
+
+static constexpr size_t LANES           = 16;
+static constexpr size_t MaxDepth        = 64;
+static constexpr size_t MaxRegisters    = 256;
+static constexpr size_t MaxInstructions = 512;
+static constexpr auto   FrameBudget     = std::chrono::milliseconds(4);
+
+static inline float _smoothstep(float e0, float e1, float x) {
+	x = (x - e0) / (e1 - e0);
+	x = x < 0 ? 0 : (x > 1 ? 1 : x);
+	return x * x * (3 - 2 * x);
+}
+
+// name, arity, function name (nullptr for operators), scalar expression
+#define SHADER_OPS(X)                                    \
+	X(Add, 2, nullptr, a + b)                              \
+	X(Sub, 2, nullptr, a - b)                              \
+	X(Mul, 2, nullptr, a * b)                              \
+	X(Div, 2, nullptr, a / b)                              \
+	X(Mod, 2, "mod", a - b * floorf(a / b))                \
+	X(Pow, 2, "pow", powf(a, b))                           \
+	X(Neg, 1, nullptr, -a)                                 \
+	X(Lt, 2, nullptr, (float)(a < b))                      \
+	X(Le, 2, nullptr, (float)(a <= b))                     \
+	X(Gt, 2, nullptr, (float)(a > b))                      \
+	X(Ge, 2, nullptr, (float)(a >= b))                     \
+	X(Eq, 2, nullptr, (float)(a == b))                     \
+	X(Ne, 2, nullptr, (float)(a != b))                     \
+	X(Sin, 1, "sin", sinf(a))                              \
+	X(Cos, 1, "cos", cosf(a))                              \
+	X(Tan, 1, "tan", tanf(a))                              \
+	X(Abs, 1, "abs", fabsf(a))                             \
+	X(Floor, 1, "floor", floorf(a))                        \
+	X(Fract, 1, "fract", a - floorf(a))                    \
+	X(Sqrt, 1, "sqrt", sqrtf(a))                           \
+	X(Exp, 1, "exp", expf(a))                              \
+	X(Log, 1, "log", logf(a))                              \
+	X(Min, 2, "min", fminf(a, b))                          \
+	X(Max, 2, "max", fmaxf(a, b))                          \
+	X(Atan2, 2, "atan2", atan2f(a, b))                     \
+	X(Step, 2, "step", (float)(b >= a))                    \
+	X(Clamp, 3, "clamp", fminf(fmaxf(a, b), c))            \
+	X(Mix, 3, "mix", a + (b - a) * c)                      \
+	X(Smoothstep, 3, "smoothstep", _smoothstep(a, b, c))   \
+	X(Select, 3, "if", a != 0 ? b : c)
+
+enum class Op : uint8_t {
+#define X(name, arity, fn, expr) name,
+	SHADER_OPS(X)
+#undef X
+};
+
+struct OpInfo {
+	const char *function;
+	unsigned    arity;
+};
+
+static const OpInfo _OpInfo[] = {
+#define X(name, arity, fn, expr) {fn, arity},
+	SHADER_OPS(X)
+#undef X
+};
+
+static float _EvalScalar(Op op, float a, float b, float c) {
+	switch (op) {
+#define X(name, arity, fn, expr) \
+	case Op::name: return expr;
+		SHADER_OPS(X)
+#undef X
+	}
+	return 0;
+}
+
+struct Instruction {
+	Op      op;
+	uint8_t d, a, b, c;
+};
+
+// runs code over the first n lanes of the register file
+static void
+_Execute(const std::vector<Instruction> &code, float *regs, size_t n) {
+	for (const auto &in : code) {
+		float *      d  = regs + in.d * LANES;
+		const float *pa = regs + in.a * LANES;
+		const float *pb = regs + in.b * LANES;
+		const float *pc = regs + in.c * LANES;
+		switch (in.op) {
+#define X(name, arity, fn, expr)       \
+	case Op::name:                       \
+		for (size_t k = 0; k < n; k++) {   \
+			[[maybe_unused]] float a = pa[k]; \
+			[[maybe_unused]] float b = pb[k]; \
+			[[maybe_unused]] float c = pc[k]; \
+			d[k]                     = expr;  \
+		}                                  \
+		break;
+			SHADER_OPS(X)
+#undef X
+		}
+	}
+}
+
+enum Input { InT, InIndex, InPosX, InPosY, InPosZ, InNormX, InNormY, InNormZ };
+
+static const std::unordered_map<std::string, Input> _Inputs = {
+	{"t", InT},
+	{"i", InIndex},
+	{"pos.x", InPosX},
+	{"pos.y", InPosY},
+	{"pos.z", InPosZ},
+	{"normal.x", InNormX},
+	{"normal.y", InNormY},
+	{"normal.z", InNormZ},
+};
+
+class ShaderCompiler {
+public:
+	struct Node {
+		enum Kind { Const, In, Apply } kind;
+		float    value   = 0;
+		Input    input   = InT;
+		Op       op      = Op::Add;
+		int      args[3] = {0, 0, 0};
+		bool     uniform = true;
+		int      reg     = -1;
+	};
+
+	enum OutputMode { Grey, RGB, HSV };
+
+	std::vector<Node>                    nodes;
+	std::unordered_map<std::string, int> variables;
+	OutputMode                           mode      = Grey;
+	int                                  output[3] = {0, 0, 0};
+	std::string                          error;
+	const char *                         p     = nullptr;
+	unsigned                             depth = 0;
+
+	int node(Node n) {
+		nodes.push_back(n);
+		return nodes.size() - 1;
+	}
+	int constant(float v) {
+		Node n;
+		n.kind  = Node::Const;
+		n.value = v;
+		return node(n);
+	}
+	int apply(Op op, int a, int b = -1, int c = -1) {
+		const int args[3] = {a, b < 0 ? a : b, c < 0 ? a : c};
+		bool      folded  = true;
+		bool      uniform = true;
+		for (unsigned k = 0; k < _OpInfo[(int)op].arity; k++) {
+			folded &= nodes[args[k]].kind == Node::Const;
+			uniform &= nodes[args[k]].uniform;
+		}
+		if (folded) {
+			return constant(_EvalScalar(
+				op, nodes[args[0]].value, nodes[args[1]].value, nodes[args[2]].value));
+		}
+		Node n;
+		n.kind    = Node::Apply;
+		n.op      = op;
+		n.uniform = uniform;
+		std::memcpy(n.args, args, sizeof(args));
+		return node(n);
+	}
+
+	bool fail(const std::string &msg) {
+		if (error.empty()) error = msg + " at '" + std::string(p).substr(0, 16) + "'";
+		return false;
+	}
+	void skip() {
+		while (isspace((unsigned char)*p)) p++;
+	}
+	bool accept(const char *tok) {
+		skip();
+		const size_t n = strlen(tok);
+		if (strncmp(p, tok, n) != 0) return false;
+		p += n;
+		return true;
+	}
+	std::string name() {
+		skip();
+		const char *start = p;
+		if (isalpha((unsigned char)*p) || *p == '_') {
+			while (isalnum((unsigned char)*p) || *p == '_' || *p == '.') p++;
+		}
+		return std::string(start, p);
+	}
+
+	bool primary(int &res) {
+		skip();
+		if (accept("(")) {
+			if (!expression(res)) return false;
+			return accept(")") || fail("expected ')'");
+		}
+		if (isdigit((unsigned char)*p) || *p == '.') {
+			char *end;
+			float v = strtof(p, &end);
+			p       = end;
+			res     = constant(v);
+			return true;
+		}
+
+		const std::string id = name();
+		if (id.empty()) return fail("expected expression");
+
+		if (accept("(")) {
+			int    args[3] = {-1, -1, -1};
+			size_t argc = 0;
+			if (!accept(")")) {
+				do {
+					if (argc >= 3) return fail("too many arguments to " + id);
+					if (!expression(args[argc++])) return false;
+				} while (accept(","));
+				if (!accept(")")) return fail("expected ')'");
+			}
+			for (size_t k = 0; k < sizeof(_OpInfo) / sizeof(*_OpInfo); k++) {
+				if (!_OpInfo[k].function || id != _OpInfo[k].function) continue;
+				if (argc != _OpInfo[k].arity) {
+					return fail("wrong number of arguments to " + id);
+				}
+				res = apply((Op)k, args[0], args[1], args[2]);
+				return true;
+			}
+			return fail("unknown function '" + id + "'");
+		}
+
+		if (auto it = variables.find(id); it != variables.end()) {
+			res = it->second;
+		} else if (auto it = _Inputs.find(id); it != _Inputs.end()) {
+			Node n;
+			n.kind    = Node::In;
+			n.input   = it->second;
+			n.uniform = it->second == InT;
+			res       = node(n);
+			variables[id] = res;
+		} else if (id == "pi") {
+			res = constant(M_PI);
+		} else if (id == "tau") {
+			res = constant(2 * M_PI);
+		} else {
+			return fail("unknown identifier '" + id + "'");
+		}
+		return true;
+	}
+
+	bool unary(int &res) {
+		if (depth >= MaxDepth) return fail("expression nested too deeply");
+		depth++;
+		bool ok = unaryInner(res);
+		depth--;
+		return ok;
+	}
+
+	bool unaryInner(int &res) {
+		if (accept("-")) {
+			if (!unary(res)) return false;
+			res = apply(Op::Neg, res);
+			return true;
+		}
+		if (!primary(res)) return false;
+		if (accept("^")) {
+			int rhs;
+			if (!unary(rhs)) return false;
+			res = apply(Op::Pow, res, rhs);
+		}
+		return true;
+	}
+
+	bool product(int &res) {
+		if (!unary(res)) return false;
+		for (;;) {
+			Op op;
+			if (accept("*")) {
+				op = Op::Mul;
+			} else if (accept("/")) {
+				op = Op::Div;
+			} else if (accept("%")) {
+				op = Op::Mod;
+			} else {
+				return true;
+			}
+			int rhs;
+			if (!unary(rhs)) return false;
+			res = apply(op, res, rhs);
+		}
+	}
+
+	bool sum(int &res) {
+		if (!product(res)) return false;
+		for (;;) {
+			Op op;
+			if (accept("+")) {
+				op = Op::Add;
+			} else if (accept("-")) {
+				op = Op::Sub;
+			} else {
+				return true;
+			}
+			int rhs;
+			if (!product(rhs)) return false;
+			res = apply(op, res, rhs);
+		}
+	}
+
+	bool expression(int &res) {
+		if (!sum(res)) return false;
+		static const std::pair<const char *, Op> comparisons[] = {
+			{"<=", Op::Le},
+			{">=", Op::Ge},
+			{"==", Op::Eq},
+			{"!=", Op::Ne},
+			{"<", Op::Lt},
+			{">", Op::Gt}};
+		for (const auto &cmp : comparisons) {
+			if (!accept(cmp.first)) continue;
+			int rhs;
+			if (!sum(rhs)) return false;
+			res = apply(cmp.second, res, rhs);
+			break;
+		}
+		return true;
+	}
+
+	bool statement() {
+		const char *start = p;
+		std::string id    = name();
+		if (!id.empty() && accept("=") && *p != '=') {
+			int res;
+			if (!expression(res)) return false;
+			variables[id] = res;
+			return true;
+		}
+
+		p = start;
+		if (!id.empty() && (id == "rgb" || id == "hsv")) {
+			name();
+			mode = id == "rgb" ? RGB : HSV;
+			if (!accept("(")) return fail("expected '('");
+			for (int k = 0; k < 3; k++) {
+				if (k > 0 && !accept(",")) return fail("expected ','");
+				if (!expression(output[k])) return false;
+			}
+			return accept(")") || fail("expected ')'");
+		}
+
+		mode = Grey;
+		return expression(output[0]);
+	}
+
+	bool compile(const char *src) {
+		p = src;
+		do {
+			skip();
+			if (*p == 0) break;
+			if (!statement()) return false;
+		} while (accept(";"));
+		skip();
+		if (*p != 0) return fail("unexpected input");
+		return true;
+	}
+};
+
+struct Shader {
+	using Compiler = ShaderCompiler;
+
+	std::vector<Instruction> uniformCode;
+	std::vector<Instruction> laneCode;
+	std::vector<std::pair<uint8_t, float>> constants;
+	std::vector<std::pair<uint8_t, Input>> inputs;
+	std::vector<uint8_t>                   uniforms;
+	uint8_t                                output[3] = {0, 0, 0};
+	Compiler::OutputMode                   mode      = Compiler::Grey;
+	size_t                                 registers = 0;
+
+	std::vector<float> regs; // LANES floats per register
+	size_t             resume = 0;
+
+	float *reg(size_t index) { return regs.data() + index * LANES; }
+
+	int emit(Compiler &c, int index, std::string &error) {
+		auto &n = c.nodes[index];
+		if (n.reg >= 0) return n.reg;
+		if (registers >= MaxRegisters) {
+			error = "expression too complex";
+			return 0;
+		}
+
+		if (n.kind == Compiler::Node::Apply) {
+			int args[3];
+			for (unsigned k = 0; k < 3; k++) {
+				args[k] = k < _OpInfo[(int)n.op].arity
+										? emit(c, n.args[k], error)
+										: c.nodes[n.args[0]].reg;
+			}
+			auto &code = n.uniform ? uniformCode : laneCode;
+			n.reg      = registers++;
+			code.push_back(
+				{n.op,
+				 (uint8_t)n.reg,
+				 (uint8_t)args[0],
+				 (uint8_t)args[1],
+				 (uint8_t)args[2]});
+			if (n.uniform) uniforms.push_back(n.reg);
+		} else {
+			n.reg = registers++;
+			if (n.kind == Compiler::Node::Const) {
+				constants.emplace_back(n.reg, n.value);
+			} else {
+				inputs.emplace_back(n.reg, n.input);
+			}
+		}
+		return n.reg;
+	}
+
+	bool compile(const char *src, std::string &error) {
+		Compiler c;
+		if (!c.compile(src)) {
+			error = c.error;
+			return false;
+		}
+		mode = c.mode;
+		for (int k = 0; k < (mode == Compiler::Grey ? 1 : 3); k++) {
+			output[k] = emit(c, c.output[k], error);
+		}
+		if (error.empty() && uniformCode.size() + laneCode.size() > MaxInstructions) {
+			error = "expression too long";
+		}
+		if (!error.empty()) return false;
+
+		regs.resize(registers * LANES);
+		for (auto &[index, value] : constants) {
+			std::fill(reg(index), reg(index) + LANES, value);
+		}
+		return true;
+	}
+
+	void iterate(const led_i_t *ledv, size_t ledn, frame_time_t t) {
+		if (ledn < 1) return;
+		const auto tStart = std::chrono::steady_clock::now();
+
+		// frame-uniform inputs and subexpressions
+		for (auto &[index, input] : inputs) {
+			if (input == InT) std::fill(reg(index), reg(index) + LANES, (float)t);
+		}
+		_Execute(uniformCode, regs.data(), 1);
+		for (auto index : uniforms) {
+			std::fill(reg(index) + 1, reg(index) + LANES, reg(index)[0]);
+		}
+
+		led_t *                 leds   = frame_raw_anim();
+		const led_coord_data_t *coords = coordinates_raw_anim();
+		if (resume >= ledn) resume = 0;
+		size_t done = 0;
+		for (size_t batch = 0; done < ledn; batch++) {
+			if (
+				((batch & 63) == 63)
+				&& (std::chrono::steady_clock::now() - tStart > FrameBudget)) {
+				break;
+			}
+			const size_t   i0 = (resume + done) % ledn;
+			const size_t   n  = std::min({LANES, ledn - i0, ledn - done});
+			const led_i_t *lv = ledv + i0;
+
+			for (auto &[index, input] : inputs) {
+				float *r = reg(index);
+				switch (input) {
+					case InT: break;
+					case InIndex:
+						for (size_t k = 0; k < n; k++) r[k] = lv[k];
+						break;
+#define COORD(in, field)                                              \
+	case in:                                                            \
+		for (size_t k = 0; k < n; k++) r[k] = coords[lv[k]].field;        \
+		break;
+						COORD(InPosX, pos.x)
+						COORD(InPosY, pos.y)
+						COORD(InPosZ, pos.z)
+						COORD(InNormX, normal.x)
+						COORD(InNormY, normal.y)
+						COORD(InNormZ, normal.z)
+#undef COORD
+				}
+			}
+
+			_Execute(laneCode, regs.data(), n);
+
+			const float *o0 = reg(output[0]);
+			const float *o1 = reg(output[1]);
+			const float *o2 = reg(output[2]);
+			for (size_t k = 0; k < n; k++) {
+				led_t *led = leds + lv[k];
+				switch (mode) {
+					case Compiler::Grey: led->r = led->g = led->b = o0[k]; break;
+					case Compiler::RGB:
+						led->r = o0[k];
+						led->g = o1[k];
+						led->b = o2[k];
+						break;
+					case Compiler::HSV: hsv(led, o0[k] * 360, o1[k], o2[k]); break;
+				}
+			}
+			done += n;
+		}
+		resume = (resume + done) % ledn;
+	}
+};
+
+extern "C" {
+
+void init(const led_i_t *, size_t, const char *argstr, void **pud) {
+	auto *shader = new Shader();
+	*pud         = shader;
+
+	// accept a quoted program as well
+	std::string src(argstr);
+	if (
+		auto b = src.find_first_not_of(" \t"), e = src.find_last_not_of(" \t\n");
+		b != std::string::npos && e > b && src[b] == src[e]
+		&& (src[b] == '"' || src[b] == '\'')) {
+		src = src.substr(b + 1, e - b - 1);
+	}
+
+	std::string error;
+	if (!shader->compile(src.c_str(), error)) {
+		RESPOND(E) << "shader: " << error << alp::over;
+		*shader = Shader();
+		shader->compile("0", error);
+	}
+}
+
+void deinit(void *ud) { delete (Shader *)ud; }
+
+void iterate(
+	const led_i_t *ledv, size_t ledn, void *ud, frame_time_t, frame_time_t t) {
+	((Shader *)ud)->iterate(ledv, ledn, t);
+}
+
+uidl_node_t *describe() { return uidl_string(0, 0); }
+}
@@ -30,11 +30,20 @@ typedef enum blend_state_t { BLEND_ACTIVE, BLEND_DONE } blend_state_t;
 typedef void (*blend_init_f)(const char *argstr, void **puserdata);
 typedef void (*blend_deinit_f)(void *userdata);
 
+// optional, called before mixing whenever the blended LEDs or their
+// coordinates changed. Allows per-LED data (e.g. projections) to be
+// precomputed into geometry, a dense array of ledn floats passed to mix.
+typedef void (*blend_prepare_f)(
+	const led_i_t *ledv, size_t ledn, float *geometry, void *userdata);
+
+// accum holds the new and op2 the old animation's colors, both dense and
+// indexed like ledv. The mixed result is written back to accum.
 typedef blend_state_t (*blend_mix_f)(
 	const led_i_t *ledv,
 	size_t         ledn,
 	led_t *        accum,
 	const led_t *  op2,
+	const float *  geometry,
 	frame_time_t   dt,
 	frame_time_t   t,
 	void *         userdata);
@@ -18,6 +18,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "alpha4c/common/linescanner.h"
 #include "alpha4c/common/math.h"
 #include "blend_api.h"
+#include "util/kernels.h"
 #include <string.h>
 
 typedef struct ud_t {
@@ -48,23 +49,17 @@ void init(const char *argstr, ud_t **pud) {
 void deinit(ud_t *ud) { free((void *)ud); }
 
 blend_state_t mix(
-	const led_i_t *ledv,
-	size_t         ledn,
-	led_t *        accum,
-	const led_t *  op2,
-	frame_time_t   dt,
+	const led_i_t *,
+	size_t       ledn,
+	led_t *      accum,
+	const led_t *op2,
+	const float *,
+	frame_time_t dt,
 	frame_time_t,
 	ud_t *ud) {
 	ud->tAnim += dt * ud->speed;
 
-	float f = fclamp(1.0f - ud->tAnim);
-	float g = fclamp(ud->tAnim);
-
-	for (size_t i = 0; i < ledn; i++) {
-		accum[ledv[i]].r = op2[i].r * f + accum[ledv[i]].r * g;
-		accum[ledv[i]].g = op2[i].g * f + accum[ledv[i]].g * g;
-		accum[ledv[i]].b = op2[i].b * f + accum[ledv[i]].b * g;
-	}
+	led_lerp(accum, op2, fclamp(1.0f - ud->tAnim), ledn);
 
 	return (ud->tAnim < 1) ? BLEND_ACTIVE : BLEND_DONE;
 }
@@ -21,6 +21,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "blend_api.h"
 #include "coordinates_api.h"
 #include "core/frame_api.h"
+#include "util/kernels.h"
 #include <string.h>
 
 typedef struct ud_t {
@@ -79,7 +80,7 @@ void init(const char *argstr, ud_t **pud) {
 	(**pud).direction = vec3f_normal(&(**pud).direction);
 
 	if (!d0set | !d1set) {
-		const led_coord_data_t *coords    = coordinates_raw_preanim();
+		const led_coord_data_t *coords    = coordinates_const_preanim();
 		const size_t            ce_coords = frame_size();
 
 		if (ce_coords > 0) {
@@ -102,29 +103,27 @@ void init(const char *argstr, ud_t **pud) {
 
 void deinit(ud_t *ud) { free((void *)ud); }
 
+void prepare(
+	const led_i_t *ledv, size_t ledn, float *geometry, const ud_t *ud) {
+	const led_coord_data_t *coords = coordinates_raw_anim();
+	for (size_t i = 0; i < ledn; i++) {
+		geometry[i] = vec3f_dot(&coords[ledv[i]].pos, &ud->direction);
+	}
+}
+
 blend_state_t mix(
-	const led_i_t *ledv,
-	size_t         ledn,
-	led_t *        accum,
-	const led_t *  op2,
-	frame_time_t   dt,
+	const led_i_t *,
+	size_t       ledn,
+	led_t *      accum,
+	const led_t *op2,
+	const float *geometry,
+	frame_time_t dt,
 	frame_time_t,
 	ud_t *ud) {
-	const led_coord_data_t *coords = coordinates_raw_anim();
 	ud->tAnim += dt * ud->speed;
 
 	float d = ud->d0 * fclamp(1.0f - ud->tAnim) + ud->d1 * fclamp(ud->tAnim);
-	float windowInv = 1.0f / ud->window;
-	for (size_t i = 0; i < ledn; i++) {
-		float d1 = vec3f_dot(&coords[ledv[i]].pos, &ud->direction);
-
-		float f = fclamp((d1 - d) * windowInv);
-		float g = 1.0f - f;
-
-		accum[ledv[i]].r = op2[i].r * f + accum[ledv[i]].r * g;
-		accum[ledv[i]].g = op2[i].g * f + accum[ledv[i]].g * g;
-		accum[ledv[i]].b = op2[i].b * f + accum[ledv[i]].b * g;
-	}
+	led_lerp_ramp(accum, op2, geometry, d, 1.0f / ud->window, ledn);
 
 	return (ud->tAnim < 1) ? BLEND_ACTIVE : BLEND_DONE;
 }
@@ -0,0 +1,47 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CANVAS_API_H
+#define CANVAS_API_H
+
+#include "core/frame_api.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Named off-screen RGB raster maintained by mod_canvas. Drawing commands
+// modify a private copy that is published on flush, so animations may read
+// canvases while rendering without locking.
+typedef struct canvas_t {
+	uint32_t     width;
+	uint32_t     height;
+	const led_t *pixels; // row-major, top row first
+	uint32_t     version; // incremented whenever pixels or size change
+} canvas_t;
+
+// returns the published state of the named canvas or 0 if there is none. The
+// pointer stays valid until the canvas is destroyed, its contents may change
+// on every flush.
+const canvas_t *canvas_get(const char *ident);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,6 +21,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "alpha4c/types/vector.h"
 #include "core/module_api.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #ifdef __cplusplus
 extern "C" {
@@ -34,8 +35,71 @@ typedef struct led_coord_data_t {
 	coord_t normal;
 } led_coord_data_t;
 
+// Binary coordinates file as read by coordinates_load: this header followed
+// by count records of components little-endian float32 values - either
+// 3 (position) or 6 (position and normal).
+#define COORDINATES_FILE_MAGIC 0x31435246u // "FRC1"
+
+typedef struct coordinates_file_header_t {
+	uint32_t magic;
+	uint32_t count;
+	uint32_t components;
+	uint32_t reserved;
+} coordinates_file_header_t;
+
+// coordinates modified via coordinates_raw_preanim() are published to
+// coordinates_raw_anim() on the next flush, incrementing coordinates_version()
+// and triggering the coordinatesChanged hook. Read-only access should go
+// through coordinates_const_preanim().
 led_coord_data_t *      coordinates_raw_preanim();
+const led_coord_data_t *coordinates_const_preanim();
 const led_coord_data_t *coordinates_raw_anim();
+uint32_t                coordinates_version();
+
+// spatial queries over the preanim coordinates, answered via a grid index that
+// is rebuilt lazily after coordinate changes. Results are sorted LED indices
+// (ordered by distance for nearest) in a buffer owned by mod_coordinates that
+// stays valid until the next query.
+size_t coordinates_query_box(
+	const coord_t *center, const coord_t *extent, const led_i_t **pbuffer);
+size_t coordinates_query_sphere(
+	const coord_t *center, coord_c_t radius, const led_i_t **pbuffer);
+// LEDs on the side of the plane through point the normal points to
+size_t coordinates_query_halfspace(
+	const coord_t *point, const coord_t *normal, const led_i_t **pbuffer);
+// LEDs within width/2 of the plane through point
+size_t coordinates_query_slab(
+	const coord_t *point,
+	const coord_t *normal,
+	coord_c_t      width,
+	const led_i_t **pbuffer);
+size_t coordinates_query_nearest(
+	const coord_t *point, size_t count, const led_i_t **pbuffer);
+
+// Neighbour graph over the anim coordinates in CSR layout: the neighbours of
+// LED i are neighbors[offsets[i] .. offsets[i + 1]), with distances[] running
+// in parallel. Each LED's neighbours are ordered by distance and never include
+// the LED itself. version equals coordinates_version() at the time of the last
+// rebuild.
+typedef struct led_graph_t {
+	size_t          count;
+	const uint32_t *offsets;
+	const led_i_t * neighbors;
+	const float *   distances;
+	uint32_t        version;
+} led_graph_t;
+
+// acquires a graph linking every LED to (up to) its k nearest neighbours
+// within radius. k = 0 links all LEDs within radius, radius <= 0 lifts the
+// distance limit. Graphs with equal parameters are shared. The graph is
+// read-only and stays valid until released. It is not rebuilt when coordinates
+// change; holders needing current neighbours call coordinates_graph_refresh,
+// e.g. from a coordinatesChanged hook, which rebuilds it once per change. All
+// three calls are only allowed during synchronization, e.g. in init and
+// deinit.
+const led_graph_t *coordinates_graph_acquire(unsigned k, coord_c_t radius);
+const led_graph_t *coordinates_graph_refresh(const led_graph_t *graph);
+void               coordinates_graph_release(const led_graph_t *graph);
 
 #ifdef __cplusplus
 }
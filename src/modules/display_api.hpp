@@ -21,6 +21,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "alpha4/common/linescanner.hpp"
 #include "alpha4/types/vector.hpp"
 #include "core/ledset.hpp"
+#include "selector.hpp"
 #include "util/module.hpp"
 extern "C" {
 #include "unicorn/idl.h"
@@ -40,45 +41,60 @@ inline bool display_processSelector(LEDSet &leds, alp::LineScanner &ln) {
 		if (cmd == "all") {
 			leds.append((led_i_t)0, (led_i_t)frame_size());
 		} else if (cmd == "voxel") {
-			typedef alp::Vector<3, coord_c_t> vec_t;
-			vec_t                             center, extent;
-			if (!ln.getAll(center.x(), center.y(), center.z(), extent.x())) {
+			coord_t center, extent;
+			if (!ln.getAll(center.x, center.y, center.z, extent.x)) {
 				RESPOND(E) << "missing center / extent for voxel selector" << alp::over;
 				return false;
 			}
-			if (ln.get(extent.y())) {
-				if (!ln.get(extent.z())) {
+			if (ln.get(extent.y)) {
+				if (!ln.get(extent.z)) {
 					RESPOND(E) << "incomplete extent for voxel selector" << alp::over;
 					return false;
 				}
 
 			} else {
-				extent.y() = extent.x();
-				extent.z() = extent.x();
+				extent.y = extent.x;
+				extent.z = extent.x;
 			}
 
-			struct coords_ext_t {
-				vec_t pos;
-				vec_t normal;
-			};
+			const led_i_t *ptr = nullptr;
+			size_t         n   = coordinates_query_box(&center, &extent, &ptr);
+			leds.append(ptr, n);
 
-			const coords_ext_t *coords =
-				(const coords_ext_t *)coordinates_raw_preanim();
+		} else if (cmd == "sphere") {
+			coord_t   center;
+			coord_c_t radius;
+			if (!ln.getAll(center.x, center.y, center.z, radius)) {
+				RESPOND(E) << "missing center / radius for sphere selector"
+									 << alp::over;
+				return false;
+			}
 
-			for (size_t i = 0, e = frame_size(); i < e; i++) {
-				if (((coords[i].pos - center).abs() - extent).count_positive() < 1) {
-					leds.append((led_i_t)i, 1);
-				}
+			const led_i_t *ptr = nullptr;
+			size_t         n   = coordinates_query_sphere(&center, radius, &ptr);
+			leds.append(ptr, n);
+
+		} else if (cmd == "halfspace") {
+			coord_t point, normal;
+			if (!ln.getAll(
+						point.x, point.y, point.z, normal.x, normal.y, normal.z)) {
+				RESPOND(E) << "missing point / normal for halfspace selector"
+									 << alp::over;
+				return false;
 			}
 
+			const led_i_t *ptr = nullptr;
+			size_t         n   = coordinates_query_halfspace(&point, &normal, &ptr);
+			leds.append(ptr, n);
+
 		} else {
 			const led_i_t *ptr = nullptr;
 			size_t         n   = group_get(cmd.c_str(), &ptr);
-			if (nullptr == ptr) {
-				RESPOND(E) << "group '" << cmd << "' does not exist" << alp::over;
+			if (nullptr != ptr) {
+				leds.append(ptr, n);
+			} else if (!SelectorExpression(cmd.c_str()).evaluate(leds)) {
 				return false;
 			}
-			leds.append(ptr, n);
 		}
 	}
 
@@ -86,23 +102,17 @@ inline bool display_processSelector(LEDSet &leds, alp::LineScanner &ln) {
 }
 
 inline uidl_node_t *display_describeSelector(const char *ident) {
+#define F uidl_float(0, 0, 0, 0)
 	uidl_node_t *res = uidl_keyword(
 		ident,
-		2,
+		4,
 		uidl_pair("all", 0),
-		uidl_pair(
-			"voxel",
-			uidl_sequence(
-				0,
-				6,
-				uidl_float(0, 0, 0, 0),
-				uidl_float(0, 0, 0, 0),
-				uidl_float(0, 0, 0, 0),
-				uidl_float(0, 0, 0, 0),
-				uidl_float(0, 0, 0, 0),
-				uidl_float(0, 0, 0, 0)))
+		uidl_pair("voxel", uidl_sequence(0, 6, F, F, F, F, F, F)),
+		uidl_pair("sphere", uidl_sequence(0, 4, F, F, F, F)),
+		uidl_pair("halfspace", uidl_sequence(0, 6, F, F, F, F, F, F))
 
 	);
+#undef F
 
 	auto groups = group_list_get();
 
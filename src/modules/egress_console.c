@@ -28,6 +28,9 @@ typedef struct userdata_t {
 	FILE *   f;
 } userdata_t;
 
+// instances may share stdout
+const unsigned Flags = EGRESS_SERIAL;
+
 void init(egressno_t, const char *argstr [[maybe_unused]], userdata_t **pud) {
 	*pud          = (userdata_t *)malloc(sizeof(userdata_t));
 	(**pud).width = 32;
@@ -24,11 +24,23 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/egress_api.h"
 #include "modules/stream_api.h"
 #include "util/egress.h"
+#include "util/interleave.h"
+#include "util/uart.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sstream>
 #include <string_view>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -43,56 +55,59 @@ struct strand_t {
 	mutable std::vector<char> buffer;
 };
 
-struct UARTEncoder {
-	uint8_t *&ptr;
-	uint8_t   currentByte = 0;
-	int       counter     = 0;
-
-	static size_t EncodedSize(size_t frames) {
-		size_t res = frames * 10;
-		return res / 8 + ((res % 8) ? 1 : 0);
-	}
-
-	UARTEncoder(uint8_t *&ptr) : ptr(ptr) {}
-
-	inline void addBit(int v) {
-		currentByte = (currentByte << 1) | (v & 1);
-		if (++counter == 8) {
-			*ptr++      = currentByte;
-			currentByte = 0;
-			counter     = 0;
-		}
-	}
-
-	inline void flush() {
-		while (counter != 0)
-			addBit(1);
-	}
-	inline void addFrame(uint8_t data) {
-		addBit(0);
-		for (int i = 0; i < 8; i++)
-			addBit(data >> i);
-		addBit(1);
-	}
-
-	inline void addIdle(size_t duration) {
-		for (size_t i = 0; i < duration; i++)
-			addBit(1);
-	}
-};
-
 struct Userdata {
 	const egressno_t      egressno;
 	struct sockaddr_in    addr;
 	std::vector<strand_t> strands;
 	bool                  buffered = false;
 
+	// delta transmission (buffered mode only): chunks whose content matches
+	// the last one sent are skipped. Every refresh frames, after failed sends
+	// and after layout changes all chunks are sent (a keyframe).
+	bool              delta         = false;
+	unsigned          refresh       = 50;
+	unsigned          sinceKeyframe = 0;
+	bool              resync        = true;
+	std::vector<char> lastSent;
+
 	mutable std::vector<char> frameHeader;
 	mutable std::vector<char> frameBuffer;
 
+	std::vector<const uint8_t *> stripeRows;
+
 	int                  sockfd = -1;
 	std::vector<uint8_t> buf;
 
+	// Frames are encoded and sent on a sender thread so a slow socket does not
+	// stall the render loop. flush copies the LEDs and stream layout into the
+	// back snapshot, which the sender swaps with its front one. Frames
+	// submitted before the sender picked up the previous one replace it.
+	struct Snapshot {
+		std::vector<led_t>        leds;
+		std::vector<led_stream_t> streams;
+	};
+	Snapshot                front;
+	Snapshot                back;
+	bool                    pending = false;
+	bool                    stop    = false;
+	std::mutex              mutex;
+	std::condition_variable cond;
+	std::thread             sender;
+
+	struct Counters {
+		std::atomic<uint64_t> frames    = 0;
+		std::atomic<uint64_t> dropped   = 0;
+		std::atomic<uint64_t> packets   = 0;
+		std::atomic<uint64_t> bytes     = 0;
+		std::atomic<uint64_t> eagain    = 0;
+		std::atomic<uint64_t> partial   = 0;
+		std::atomic<uint64_t> errors    = 0;
+		std::atomic<uint64_t> chunks    = 0;
+		std::atomic<uint64_t> skipped   = 0;
+		std::atomic<uint64_t> keyframes = 0;
+		std::atomic<int>      lastErrno = 0;
+	} counters;
+
 	Userdata(egressno_t egressno, const char *argstr) : egressno(egressno) {
 		alp::LineScanner ln(argstr);
 		{ // get host and port
@@ -124,6 +139,13 @@ struct Userdata {
 			while (ln.get(str)) {
 				if (str == "buffered") {
 					buffered = true;
+				} else if (str == "delta") {
+					delta = true;
+				} else if (str == "refresh") {
+					if (!ln.get(refresh) || (refresh < 1)) {
+						alp::thrower<alp::Exception>()
+							<< "invalid upsilon egress refresh interval" << alp::over;
+					}
 				} else if (str == "upsilon2") {
 					newStrand.mode = strand_t::Upsilon2;
 				} else if (str == "ws2811") {
@@ -152,27 +174,112 @@ struct Userdata {
 		}
 
 		sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		sender = std::thread(&Userdata::_send, this);
 	}
 
 	~Userdata() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		cond.notify_one();
+		sender.join();
+
 		if (sockfd != -1) {
 			shutdown(sockfd, SHUT_RDWR);
 			close(sockfd);
 		}
 	}
 
-	void update(led_i_t firstLED, led_i_t) {
-		// todo: double check that count is correct
+	void submit(led_i_t firstLED, led_i_t count) {
+		led_stream_t *streams    = nullptr;
+		size_t        ce_streams = streams_get(egressno, &streams);
+		if ((ce_streams < 1) || (nullptr == streams)) return;
+
+		const led_t *leds = frame_raw_egress() + firstLED;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			back.leds.assign(leds, leds + count);
+			back.streams.assign(streams, streams + ce_streams);
+			if (pending) counters.dropped++;
+			pending = true;
+		}
+		cond.notify_one();
+	}
+
+	void _send() {
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&] { return pending || stop; });
+				if (stop) return;
+				std::swap(front, back);
+				pending = false;
+			}
+			update(front);
+			counters.frames++;
+		}
+	}
+
+	// returns true if the whole packet was sent. Failures force a keyframe.
+	// Sends don't block, so a full socket buffer shows up as EAGAIN. The
+	// packet is then retried once the socket becomes writable, waiting at most
+	// SendTimeout, and dropped if that fails as well.
+	static constexpr int SendTimeout = 10; // ms
+	bool sendPacket(const char *data, size_t size) {
+		ssize_t res;
+		for (int attempt = 0;; attempt++) {
+			res = sendto(
+				sockfd,
+				data,
+				size,
+				MSG_DONTWAIT,
+				(struct sockaddr *)&addr,
+				sizeof(struct sockaddr_in));
+			if ((res >= 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))) break;
+			counters.eagain++;
+			if (attempt > 0) break;
+			struct pollfd pfd = {sockfd, POLLOUT, 0};
+			poll(&pfd, 1, SendTimeout);
+		}
+		if (res < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+				counters.errors++;
+				counters.lastErrno = errno;
+			}
+		} else if ((size_t)res < size) {
+			counters.partial++;
+		} else {
+			counters.packets++;
+			counters.bytes += res;
+			return true;
+		}
+		resync = true;
+		return false;
+	}
+
+	void status(std::ostream &out) const {
+		out << " frames:" << counters.frames << " dropped:" << counters.dropped
+				<< " packets:" << counters.packets << " bytes:" << counters.bytes
+				<< " eagain:" << counters.eagain << " partial:" << counters.partial
+				<< " errors:" << counters.errors;
+		if (delta) {
+			out << " chunks:" << counters.chunks << " skipped:" << counters.skipped
+					<< " keyframes:" << counters.keyframes;
+		}
+		if (counters.errors > 0) {
+			out << " (last: " << strerror(counters.lastErrno) << ")";
+		}
+	}
+
+	void update(const Snapshot &snapshot) {
 		if (strands.size() < 1) return;
 		constexpr const size_t cb_command_header = 8;
 
 		{ // fill strand buffers
-			led_stream_t *streams    = nullptr;
-			size_t        ce_streams = streams_get(egressno, &streams);
-
-			if ((ce_streams < 1) || (nullptr == streams)) return;
-
-			const auto *leds = frame_raw_egress();
+			const led_stream_t *streams    = snapshot.streams.data();
+			const size_t        ce_streams = snapshot.streams.size();
+			const led_t *       leds       = snapshot.leds.data();
 
 			auto     it_strand     = strands.begin();
 			auto     end_strand    = strands.end();
@@ -181,7 +288,7 @@ struct Userdata {
 			uint16_t strand_offset = 0;
 			size_t   stream_offset = 0;
 			size_t   buffer_offset = 0;
-			size_t   led_offset    = firstLED;
+			size_t   led_offset    = 0;
 			uint8_t  u2_index      = 0;
 			auto     streamInfo    = streams_getInfo();
 
@@ -201,10 +308,12 @@ struct Userdata {
 				}
 			};
 
-			while ((it_strand != end_strand) && (it_stream != end_stream)) {
+			while ((it_strand != end_strand) && (it_stream != end_stream)
+						 && (led_offset < snapshot.leds.size())) {
 				uint16_t count = std::min(
-					it_strand->count - strand_offset,
-					(int)(it_stream->count - stream_offset));
+					{it_strand->count - strand_offset,
+					 (int)(it_stream->count - stream_offset),
+					 (int)(snapshot.leds.size() - led_offset)});
 				size_t cb = 0;
 				switch (it_strand->mode) {
 					case strand_t::WS2811:
@@ -289,8 +398,23 @@ struct Userdata {
 			}
 			if (frameBuffer.size() != cb_total) { frameBuffer.resize(cb_total); }
 
-			size_t i_round = 0;
-			for (char *pbuf = frameBuffer.data() + cb_command_header,
+			// interleave the range all strands cover at once, then the rest of
+			// the longer strands round by round
+			size_t common = SIZE_MAX;
+			stripeRows.clear();
+			for (const auto &strand : strands) {
+				stripeRows.push_back((const uint8_t *)strand.buffer.data());
+				common = std::min(common, strand.buffer.size());
+			}
+			bytes_interleave(
+				(uint8_t *)frameBuffer.data() + cb_command_header,
+				stripeRows.data(),
+				stripeRows.size(),
+				common);
+
+			size_t i_round = common;
+			for (char *pbuf = frameBuffer.data() + cb_command_header
+												+ common * strands.size(),
 								*ebuf = frameBuffer.data() + cb_total;
 					 pbuf < ebuf;) {
 				for (auto &strand : strands) {
@@ -302,13 +426,8 @@ struct Userdata {
 		}
 
 		// start the frame
-		sendto(
-			sockfd,
-			frameHeader.data(),
-			frameHeader.size(),
-			MSG_WAITALL,
-			(struct sockaddr *)&addr,
-			sizeof(struct sockaddr_in));
+		// runs on the sender thread, sendPacket waits briefly on a full socket
+		sendPacket(frameHeader.data(), frameHeader.size());
 
 		// {
 		// 	using namespace std::chrono_literals;
@@ -327,18 +446,27 @@ struct Userdata {
 				// add the command header
 				buf[ib - 1] = 0x52;
 
-				sendto(
-					sockfd,
-					buf + ib - 1,
-					cb_msg + 1,
-					MSG_DONTWAIT,
-					(struct sockaddr *)&addr,
-					sizeof(struct sockaddr_in));
+				sendPacket(buf + ib - 1, cb_msg + 1);
 			}
 		} else { // blt out frame buffer
 			const size_t stride = 512;
 			const size_t cb_buf = frameBuffer.size();
 			char *       buf    = frameBuffer.data();
+
+			const bool keyframe =
+				!delta || resync || (sinceKeyframe + 1 >= refresh)
+				|| (lastSent.size() != cb_buf);
+			if (delta) {
+				if (keyframe) {
+					counters.keyframes++;
+					lastSent.resize(cb_buf);
+					sinceKeyframe = 0;
+				} else {
+					sinceKeyframe++;
+				}
+				resync = false;
+			}
+
 			// stream in one additional byte of padding
 			size_t n = 0;
 			for (size_t ib = cb_command_header; ib < cb_buf; ib += stride) {
@@ -346,21 +474,28 @@ struct Userdata {
 				const size_t busaddr = 0x2000'0000 + ib - cb_command_header;
 				if (ib + cb_msg > cb_buf) cb_msg = cb_buf - ib;
 
+				// skip unchanged chunks, except for the last one, which completes
+				// the frame
+				const bool last = (ib + stride >= cb_buf);
+				if (delta) {
+					counters.chunks++;
+					if (!keyframe && !last
+							&& (memcmp(buf + ib, lastSent.data() + ib, cb_msg) == 0)) {
+						counters.skipped++;
+						continue;
+					}
+					memcpy(lastSent.data() + ib, buf + ib, cb_msg);
+				}
+
 				// add the command header
 				buf[ib - 6] = 0x42;                                  // command
-				buf[ib - 5] = (ib + stride >= cb_buf) ? 0x01 : 0x00; // flags
+				buf[ib - 5] = last ? 0x01 : 0x00;                    // flags
 				buf[ib - 4] = (busaddr >> 24) & 0xff;                // busaddr
 				buf[ib - 3] = (busaddr >> 16) & 0xff;                // busaddr
 				buf[ib - 2] = (busaddr >> 8) & 0xff;                 // busaddr
 				buf[ib - 1] = (busaddr)&0xff;                        // busaddr
 
-				sendto(
-					sockfd,
-					buf + ib - 6,
-					cb_msg + 6,
-					MSG_DONTWAIT,
-					(struct sockaddr *)&addr,
-					sizeof(struct sockaddr_in));
+				sendPacket(buf + ib - 6, cb_msg + 6);
 				n++;
 			}
 		}
@@ -376,7 +511,13 @@ void init(egressno_t egressno, const char *argstr, Userdata **puserdata) {
 void deinit(Userdata *userdata) { delete userdata; }
 
 void flush(led_i_t firstLED, led_i_t count, Userdata *userdata) {
-	userdata->update(firstLED, count);
+	userdata->submit(firstLED, count);
+}
+
+size_t status(Userdata *userdata, char *buf, size_t size) {
+	std::ostringstream out;
+	userdata->status(out);
+	return snprintf(buf, size, "%s", out.str().c_str());
 }
 uidl_node_t *describe() {
 	return uidl_sequence(
@@ -389,8 +530,10 @@ uidl_node_t *describe() {
 			0,
 			uidl_keyword(
 				0,
-				3,
+				5,
 				uidl_pair("buffered", 0),
+				uidl_pair("delta", 0),
+				uidl_pair("refresh", uidl_integer(0, UIDL_LIMIT_LOWER, 1, 0)),
 				uidl_pair("upsilon2", 0),
 				uidl_pair("ws2811", 0)
 
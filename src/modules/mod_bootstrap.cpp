@@ -240,11 +240,42 @@ static uidl_node_t *_desc_egress_set_active(void *) {
 		0, 2, stringlist_to_idl(egress_list_get(), true), uidl_integer(0, 0, 0, 0));
 }
 
+static void _cmd_egress_set_latency(modno_t, const char *argstr, void *) {
+	egressno_t                     egressno = INVALID_EGRESS;
+	std::string                    instanceName;
+	alp::LineScanner::DecodeBuffer buf;
+	double                         milliseconds = 0;
+	MODULE_SAFECALL(
+		"egress_set_latency", alp::LineScanner::DecodeBuffer buf; {
+			alp::LineScanner ln(argstr);
+			instanceName = ln.decode<std::string>(buf);
+			milliseconds = ln.decode<double>(buf);
+			egressno     = egress_find(instanceName.c_str(), nullptr);
+		});
+
+	if (egressno == INVALID_EGRESS) {
+		RESPOND(W) << "egress module instance " << instanceName
+							 << " not found - cannot set latency" << alp::over;
+		return;
+	}
+
+	egress_set_latency(egressno, milliseconds * 1e-3);
+}
+
+static uidl_node_t *_desc_egress_set_latency(void *) {
+	return uidl_sequence(
+		0,
+		2,
+		stringlist_to_idl(egress_list_get(), true),
+		uidl_float(0, 0, 0, 0));
+}
+
 void        mod_display_status();
 static void _cmd_status(modno_t, const char *, void *) {
 	basemodule_status();
 	module_status();
 	egress_status();
+	frame_status();
 	anim_status();
 	mod_display_status();
 }
@@ -286,6 +317,11 @@ void init(modno_t modno, const char *, void **) {
 		"egress_set_active",
 		_cmd_egress_set_active,
 		_desc_egress_set_active);
+	module_register_command(
+		modno,
+		"egress_set_latency",
+		_cmd_egress_set_latency,
+		_desc_egress_set_latency);
 	module_register_command(modno, "status", _cmd_status, nullptr);
 	module_register_command(modno, "idl", _cmd_idl, nullptr);
 	module_register_command(modno, "quit", _cmd_quit, nullptr);
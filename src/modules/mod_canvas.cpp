@@ -0,0 +1,273 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "alpha4/common/linescanner.hpp"
+#include "alpha4/common/logger.hpp"
+#include "core/module_api.h"
+#include "modules/canvas_api.h"
+#include "util/module.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Canvas {
+	uint32_t           width  = 0;
+	uint32_t           height = 0;
+	std::vector<led_t> pixels;
+
+	// published state handed out to animations
+	std::vector<led_t> published;
+	canvas_t           view{};
+	bool               dirty = true;
+
+	led_t *row(uint32_t y) { return pixels.data() + (size_t)y * width; }
+
+	void resize(uint32_t w, uint32_t h) {
+		width  = w;
+		height = h;
+		pixels.assign((size_t)w * h, {0, 0, 0});
+		dirty = true;
+	}
+
+	// fills the intersection of the canvas and the given rectangle
+	void rect(long x, long y, long w, long h, const led_t &color) {
+		const long x0 = std::max(x, 0l), x1 = std::min(x + w, (long)width);
+		const long y0 = std::max(y, 0l), y1 = std::min(y + h, (long)height);
+		for (long yy = y0; yy < y1; yy++) {
+			std::fill(row(yy) + x0, row(yy) + x1, color);
+		}
+		dirty = true;
+	}
+
+	// shifts contents by (dx, dy) pixels, wrapping around the edges
+	void scroll(long dx, long dy) {
+		if ((width < 1) | (height < 1)) return;
+		dx = ((dx % (long)width) + width) % width;
+		dy = ((dy % (long)height) + height) % height;
+		std::rotate(
+			pixels.begin(),
+			pixels.begin() + (size_t)(height - dy) * width,
+			pixels.end());
+		for (uint32_t y = 0; y < height; y++) {
+			std::rotate(row(y), row(y) + (width - dx), row(y) + width);
+		}
+		dirty = true;
+	}
+
+	void publish() {
+		if (!dirty) return;
+		dirty       = false;
+		published   = pixels;
+		view.width  = width;
+		view.height = height;
+		view.pixels = published.data();
+		view.version++;
+	}
+};
+
+static std::unordered_map<std::string, std::unique_ptr<Canvas>> _Canvases;
+
+static Canvas *_Find(const std::string &ident) {
+	if (auto it = _Canvases.find(ident); it != _Canvases.end()) {
+		return it->second.get();
+	}
+	RESPOND(E) << "canvas '" << ident << "' does not exist" << alp::over;
+	return nullptr;
+}
+
+// reads a binary (P6) portable pixmap into a canvas at (x, y)
+static bool _BlitPPM(Canvas &canvas, const char *fn, long x, long y) {
+	FILE *f = fopen(fn, "rb");
+	if (!f) {
+		RESPOND(E) << "cannot open '" << fn << "'" << alp::over;
+		return false;
+	}
+	std::unique_ptr<FILE, decltype(&fclose)> guard(f, &fclose);
+
+	// header: magic, width, height and maxval separated by whitespace and
+	// comments, followed by a single whitespace character
+	char     magic[3] = {0};
+	unsigned header[3];
+	if (fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || magic[1] != '6') {
+		RESPOND(E) << "'" << fn << "' is not a binary PPM file" << alp::over;
+		return false;
+	}
+	for (auto &v : header) {
+		int c;
+		while ((c = fgetc(f)) != EOF) {
+			if (c == '#') {
+				while ((c = fgetc(f)) != EOF && c != '\n') {}
+			} else if (!isspace(c)) {
+				ungetc(c, f);
+				break;
+			}
+		}
+		if (fscanf(f, "%u", &v) != 1) {
+			RESPOND(E) << "malformed PPM header in '" << fn << "'" << alp::over;
+			return false;
+		}
+	}
+	fgetc(f);
+	const unsigned w = header[0], h = header[1], maxval = header[2];
+	if ((maxval < 1) || (maxval > 255)) {
+		RESPOND(E) << "unsupported PPM maxval in '" << fn << "'" << alp::over;
+		return false;
+	}
+
+	std::vector<uint8_t> data((size_t)w * h * 3);
+	if (fread(data.data(), 1, data.size(), f) != data.size()) {
+		RESPOND(E) << "truncated PPM file '" << fn << "'" << alp::over;
+		return false;
+	}
+
+	const float scale = 1.0f / maxval;
+	for (long yy = std::max(0l, -y); yy < (long)h && yy + y < canvas.height;
+			 yy++) {
+		const uint8_t *src = data.data() + (size_t)yy * w * 3;
+		led_t *        dst = canvas.row(yy + y);
+		for (long xx = std::max(0l, -x); xx < (long)w && xx + x < canvas.width;
+				 xx++) {
+			dst[xx + x] = {
+				src[xx * 3 + 0] * scale, src[xx * 3 + 1] * scale, src[xx * 3 + 2] * scale};
+		}
+	}
+	canvas.dirty = true;
+	return true;
+}
+
+extern "C" {
+
+modno_t SingletonInstance = INVALID_MODULE;
+
+static void _cmd_canvas_create(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_create", {
+		alp::LineScanner::Call(
+			[&](const std::string &ident, uint32_t width, uint32_t height) -> void {
+				if ((width < 1) || (height < 1)) {
+					RESPOND(E) << "canvas dimensions must be positive" << alp::over;
+					return;
+				}
+				auto &canvas = _Canvases[ident];
+				if (!canvas) canvas = std::make_unique<Canvas>();
+				canvas->resize(width, height);
+			},
+			argstr);
+	});
+}
+
+static void _cmd_canvas_destroy(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_destroy", {
+		alp::LineScanner::Call(
+			[&](const std::string &ident) -> void {
+				if (_Canvases.erase(ident) < 1) {
+					RESPOND(E) << "canvas '" << ident << "' does not exist"
+										 << alp::over;
+				}
+			},
+			argstr);
+	});
+}
+
+static void _cmd_canvas_fill(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_fill", {
+		alp::LineScanner::Call(
+			[&](const std::string &ident, float r, float g, float b) -> void {
+				if (auto canvas = _Find(ident)) {
+					canvas->rect(0, 0, canvas->width, canvas->height, {r, g, b});
+				}
+			},
+			argstr);
+	});
+}
+
+static void _cmd_canvas_rect(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_rect", {
+		alp::LineScanner::Call(
+			[&](
+				const std::string &ident,
+				long               x,
+				long               y,
+				long               w,
+				long               h,
+				float              r,
+				float              g,
+				float              b) -> void {
+				if (auto canvas = _Find(ident)) canvas->rect(x, y, w, h, {r, g, b});
+			},
+			argstr);
+	});
+}
+
+static void _cmd_canvas_blit(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_blit", {
+		alp::LineScanner ln(argstr);
+		std::string      ident;
+		std::string      fn;
+		long             x = 0;
+		long             y = 0;
+		if (!ln.getAll(ident, fn)) {
+			RESPOND(E) << "usage: canvas_blit <canvas> <ppm file> [<x> <y>]"
+								 << alp::over;
+			return;
+		}
+		if (ln.get(x) && !ln.get(y)) {
+			RESPOND(E) << "incomplete blit position" << alp::over;
+			return;
+		}
+		if (auto canvas = _Find(ident)) _BlitPPM(*canvas, fn.c_str(), x, y);
+	});
+}
+
+static void _cmd_canvas_scroll(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("canvas_scroll", {
+		alp::LineScanner::Call(
+			[&](const std::string &ident, long dx, long dy) -> void {
+				if (auto canvas = _Find(ident)) canvas->scroll(dx, dy);
+			},
+			argstr);
+	});
+}
+
+void init(modno_t modno, const char *, void **) {
+	module_register_command(
+		modno, "canvas_create", _cmd_canvas_create, nullptr);
+	module_register_command(
+		modno, "canvas_destroy", _cmd_canvas_destroy, nullptr);
+	module_register_command(modno, "canvas_fill", _cmd_canvas_fill, nullptr);
+	module_register_command(modno, "canvas_rect", _cmd_canvas_rect, nullptr);
+	module_register_command(modno, "canvas_blit", _cmd_canvas_blit, nullptr);
+	module_register_command(
+		modno, "canvas_scroll", _cmd_canvas_scroll, nullptr);
+}
+void deinit(modno_t, void *) { _Canvases.clear(); }
+void flush(modno_t, void *) {
+	for (auto &it : _Canvases) it.second->publish();
+}
+
+const canvas_t *canvas_get(const char *ident) {
+	if (auto it = _Canvases.find(ident); it != _Canvases.end()) {
+		return &it->second->view;
+	}
+	return nullptr;
+}
+}
@@ -25,49 +25,304 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/module_api.h"
 #include "modules/coordinates_api.h"
 #include "util/module.hpp"
+#include "util/spatial.hpp"
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <stdio.h>
 #include <vector>
 
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static std::vector<led_coord_data_t> _Coordinates_preanim;
 static std::vector<led_coord_data_t> _Coordinates_anim;
 
+// set whenever the preanim coordinates may have been modified. They are only
+// published to the anim buffer on flush if so.
+static bool     _Dirty   = true;
+static uint32_t _Version = 0;
+
+// spatial index over the preanim coordinates, rebuilt on the next query after
+// any change
+static SpatialGrid          _Index;
+static bool                 _IndexDirty = true;
+static std::vector<led_i_t> _QueryResult;
+
+static void _CoordinatesChanged() {
+	_Dirty      = true;
+	_IndexDirty = true;
+}
+
+static const SpatialGrid &_GetIndex() {
+	if (_IndexDirty) {
+		_Index.build(
+			&_Coordinates_preanim.data()->pos.x,
+			_Coordinates_preanim.size(),
+			sizeof(led_coord_data_t) / sizeof(float));
+		_IndexDirty = false;
+	}
+	return _Index;
+}
+
+// neighbour graphs shared among animations, built from the anim coordinates
+// on acquisition and rebuilt lazily when refreshed after these changed
+struct Graph {
+	unsigned              k;
+	float                 radius;
+	unsigned              refs  = 1;
+	bool                  built = false;
+	std::vector<uint32_t> offsets;
+	std::vector<led_i_t>  neighbors;
+	std::vector<float>    distances;
+	led_graph_t           view{};
+
+	void build(const SpatialGrid &grid) {
+		const size_t                           n  = _Coordinates_anim.size();
+		const float                            r2 = radius > 0 ? radius * radius : 0;
+		std::vector<SpatialGrid::index_t>      found;
+		std::vector<std::pair<float, led_i_t>> sorted;
+
+		offsets.assign(n + 1, 0);
+		neighbors.clear();
+		distances.clear();
+		for (size_t i = 0; i < n; i++) {
+			const coord_t &c    = _Coordinates_anim[i].pos;
+			const float    p[3] = {c.x, c.y, c.z};
+			found.clear();
+			if (k > 0) {
+				// one extra to make up for the LED itself
+				grid.nearest(p, k + 1, found);
+			} else {
+				grid.sphere(p, radius, found);
+			}
+
+			sorted.clear();
+			for (auto j : found) {
+				if (j == i) continue;
+				const coord_t &o = _Coordinates_anim[j].pos;
+				float d[3]       = {o.x - c.x, o.y - c.y, o.z - c.z};
+				float d2         = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+				if ((r2 > 0) && (d2 > r2)) continue;
+				sorted.emplace_back(d2, (led_i_t)j);
+			}
+			std::sort(sorted.begin(), sorted.end());
+			if ((k > 0) && (sorted.size() > k)) sorted.resize(k);
+
+			for (auto &e : sorted) {
+				neighbors.push_back(e.second);
+				distances.push_back(std::sqrt(e.first));
+			}
+			offsets[i + 1] = neighbors.size();
+		}
+
+		view.count     = n;
+		view.offsets   = offsets.data();
+		view.neighbors = neighbors.data();
+		view.distances = distances.data();
+		view.version   = _Version;
+		built          = true;
+	}
+
+	bool stale() const { return !built || (view.version != _Version); }
+};
+static std::vector<std::unique_ptr<Graph>> _Graphs;
+
+static void _BuildGraph(Graph &graph) {
+	// the query index covers the preanim coordinates, which match the anim
+	// ones unless changes are pending
+	if (!_Dirty) {
+		graph.build(_GetIndex());
+		return;
+	}
+	SpatialGrid grid;
+	grid.build(
+		&_Coordinates_anim.data()->pos.x,
+		_Coordinates_anim.size(),
+		sizeof(led_coord_data_t) / sizeof(float));
+	graph.build(grid);
+}
+
+static size_t _QueryDone(const led_i_t **pbuffer, bool sort = true) {
+	if (sort) std::sort(_QueryResult.begin(), _QueryResult.end());
+	if (pbuffer) *pbuffer = _QueryResult.data();
+	return _QueryResult.size();
+}
+
+// read-only view of a file's contents, memory-mapped where supported
+class FileView {
+protected:
+	const uint8_t *_data = nullptr;
+	size_t         _size = 0;
+#if defined(__linux__)
+	void *_map = MAP_FAILED;
+#else
+	std::vector<uint8_t> _buffer;
+#endif
+
+public:
+	FileView(const char *fn) {
+#if defined(__linux__)
+		int fd = open(fn, O_RDONLY);
+		if (fd < 0) return;
+		struct stat st;
+		if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+			_map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (_map != MAP_FAILED) {
+				_data = (const uint8_t *)_map;
+				_size = st.st_size;
+			}
+		}
+		close(fd);
+#else
+		FILE *f = fopen(fn, "rb");
+		if (!f) return;
+		uint8_t chunk[4096];
+		size_t  n;
+		while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+			_buffer.insert(_buffer.end(), chunk, chunk + n);
+		}
+		fclose(f);
+		_data = _buffer.data();
+		_size = _buffer.size();
+#endif
+	}
+	~FileView() {
+#if defined(__linux__)
+		if (_map != MAP_FAILED) munmap(_map, _size);
+#endif
+	}
+	FileView(const FileView &) = delete;
+
+	const uint8_t *data() const { return _data; }
+	size_t         size() const { return _size; }
+};
+
+static bool _ResolveOffset(const std::string &egressName, size_t &offset) {
+	if (egressName.empty()) {
+		return true;
+	} else if (egressno_t egressno = egress_find(egressName.c_str(), nullptr);
+						 egressno != INVALID_EGRESS) {
+		offset += egress_offset(egressno);
+		return true;
+	}
+	RESPOND(E) << "egress instance '" << egressName << "' does not exist"
+						 << alp::over;
+	return false;
+}
+
 extern "C" {
 
 modno_t SingletonInstance = INVALID_MODULE;
 
 static void _cmd_coordinates_set(modno_t, const char *argstr, void *);
+static void _cmd_coordinates_load(modno_t, const char *argstr, void *);
 
 static void _hook_ledsAdded(hook_t, modno_t, void *) {
 	_Coordinates_preanim.resize(
 		_Coordinates_preanim.size() + egress_leds_added_count(),
 		{{0, 0, 0}, {0, 0, 0}});
+	_CoordinatesChanged();
 }
 static void _hook_ledsRemoved(hook_t, modno_t, void *) {
 	_Coordinates_preanim.erase(
 		_Coordinates_preanim.begin() + egress_leds_removed_offset(),
 		_Coordinates_preanim.begin()
 			+ (egress_leds_removed_offset() + egress_leds_removed_count()));
+	_CoordinatesChanged();
 }
 
 void init(modno_t modno, const char *, void **) {
 	module_register_command(
 		modno, "coordinates_set", _cmd_coordinates_set, nullptr);
+	module_register_command(
+		modno, "coordinates_load", _cmd_coordinates_load, nullptr);
 	module_hook(modno, hook_resolve("ledsAdded"), _hook_ledsAdded);
 	module_hook(modno, hook_resolve("ledsRemoved"), _hook_ledsRemoved);
 }
 void deinit(modno_t, void *) {
 	_Coordinates_preanim.clear();
 	_Coordinates_anim.clear();
+	_Index.clear();
+	_QueryResult.clear();
+	_Graphs.clear();
+	_CoordinatesChanged();
+}
+void flush(modno_t, void *) {
+	if (!_Dirty) return;
+	_Dirty            = false;
+	_Coordinates_anim = _Coordinates_preanim;
+	_Version++;
+
+	static hook_t hook = INVALID_HOOK;
+	if (hook == INVALID_HOOK) hook = hook_resolve("coordinatesChanged");
+	hook_trigger(hook);
 }
-void flush(modno_t, void *) { _Coordinates_anim = _Coordinates_preanim; }
 
 led_coord_data_t *coordinates_raw_preanim() {
+	// callers may write through this pointer
+	_CoordinatesChanged();
+	return _Coordinates_preanim.data();
+}
+const led_coord_data_t *coordinates_const_preanim() {
 	return _Coordinates_preanim.data();
 }
 const led_coord_data_t *coordinates_raw_anim() {
 	return _Coordinates_anim.data();
 }
+uint32_t coordinates_version() { return _Version; }
+
+size_t coordinates_query_box(
+	const coord_t *center, const coord_t *extent, const led_i_t **pbuffer) {
+	const float c[3] = {center->x, center->y, center->z};
+	const float e[3] = {extent->x, extent->y, extent->z};
+	_QueryResult.clear();
+	_GetIndex().box(c, e, _QueryResult);
+	return _QueryDone(pbuffer);
+}
+
+size_t coordinates_query_sphere(
+	const coord_t *center, coord_c_t radius, const led_i_t **pbuffer) {
+	const float c[3] = {center->x, center->y, center->z};
+	_QueryResult.clear();
+	_GetIndex().sphere(c, radius, _QueryResult);
+	return _QueryDone(pbuffer);
+}
+
+size_t coordinates_query_halfspace(
+	const coord_t *point, const coord_t *normal, const led_i_t **pbuffer) {
+	const float n[3] = {normal->x, normal->y, normal->z};
+	const float d    = vec3f_dot(point, normal);
+	_QueryResult.clear();
+	_GetIndex().band(n, d, std::numeric_limits<float>::infinity(), _QueryResult);
+	return _QueryDone(pbuffer);
+}
+
+size_t coordinates_query_slab(
+	const coord_t *point,
+	const coord_t *normal,
+	coord_c_t      width,
+	const led_i_t **pbuffer) {
+	coord_t     nn   = vec3f_normal(normal);
+	const float n[3] = {nn.x, nn.y, nn.z};
+	const float d    = vec3f_dot(point, &nn);
+	_QueryResult.clear();
+	_GetIndex().band(n, d - width * 0.5f, d + width * 0.5f, _QueryResult);
+	return _QueryDone(pbuffer);
+}
+
+size_t coordinates_query_nearest(
+	const coord_t *point, size_t count, const led_i_t **pbuffer) {
+	const float p[3] = {point->x, point->y, point->z};
+	_QueryResult.clear();
+	_GetIndex().nearest(p, count, _QueryResult);
+	return _QueryDone(pbuffer, false);
+}
 
 static void _cmd_coordinates_set(modno_t, const char *argstr, void *) {
 	alp::LineScanner ln(argstr);
@@ -83,15 +338,7 @@ static void _cmd_coordinates_set(modno_t, const char *argstr, void *) {
 		return;
 	}
 
-	if (egressName.empty()) {
-	} else if (egressno_t egressno = egress_find(egressName.c_str(), nullptr);
-						 egressno != INVALID_EGRESS) {
-		offset += egress_offset(egressno);
-	} else {
-		RESPOND(E) << "egress instance '" << egressName << "' does not exist"
-							 << alp::over;
-		return;
-	}
+	if (!_ResolveOffset(egressName, offset)) return;
 
 	const size_t     end = frame_size();
 	led_coord_data_t tmp;
@@ -107,6 +354,80 @@ static void _cmd_coordinates_set(modno_t, const char *argstr, void *) {
 
 		_Coordinates_preanim[i] = tmp;
 	}
+	_CoordinatesChanged();
+}
+
+static void _cmd_coordinates_load(modno_t, const char *argstr, void *) {
+	alp::LineScanner ln(argstr);
+
+	std::string fn;
+	std::string egressName;
+	size_t      offset = 0;
+
+	if (!ln.get(fn)) {
+		RESPOND(E) << "incomplete coordinates_load command - missing file name"
+							 << alp::over;
+		return;
+	}
+	if (ln.get(egressName) && !ln.get(offset)) {
+		RESPOND(E) << "incomplete coordinates_load command - missing offset"
+							 << alp::over;
+		return;
+	}
+	if (!_ResolveOffset(egressName, offset)) return;
+
+	FileView file(fn.c_str());
+	if (!file.data()) {
+		RESPOND(E) << "unable to read coordinates file '" << fn << "'"
+							 << alp::over;
+		return;
+	}
+
+	coordinates_file_header_t header;
+	if (file.size() < sizeof(header)) {
+		RESPOND(E) << "coordinates file '" << fn << "' is truncated" << alp::over;
+		return;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != COORDINATES_FILE_MAGIC) {
+		RESPOND(E) << "'" << fn << "' is not a coordinates file" << alp::over;
+		return;
+	}
+	if ((header.components != 3) && (header.components != 6)) {
+		RESPOND(E) << "unsupported component count in coordinates file '" << fn
+							 << "': " << header.components << alp::over;
+		return;
+	}
+
+	const size_t stride = header.components * sizeof(float);
+	if (file.size() < sizeof(header) + header.count * stride) {
+		RESPOND(E) << "coordinates file '" << fn << "' is truncated" << alp::over;
+		return;
+	}
+	if (offset + header.count > frame_size()) {
+		RESPOND(E) << "coordinates file '" << fn << "' holds " << header.count
+							 << " LEDs, exceeding the frame (" << frame_size()
+							 << " LEDs) at offset " << offset << alp::over;
+		return;
+	}
+
+	const uint8_t *   src = file.data() + sizeof(header);
+	led_coord_data_t *dst = _Coordinates_preanim.data() + offset;
+	if ((header.components == 6) && (sizeof(led_coord_data_t) == stride)) {
+		memcpy((void *)dst, src, header.count * stride);
+	} else {
+		for (size_t i = 0; i < header.count; i++, src += stride) {
+			memcpy((void *)&dst[i].pos, src, 3 * sizeof(float));
+			if (header.components == 6) {
+				memcpy(
+					(void *)&dst[i].normal, src + 3 * sizeof(float), 3 * sizeof(float));
+			}
+		}
+	}
+	_CoordinatesChanged();
+
+	RESPOND(I) << "loaded " << header.count << " coordinates from '" << fn
+						 << "'" << alp::over;
 }
 
 uidl_node_t *_desc_module_remove(void *) {
@@ -135,4 +456,46 @@ uidl_node_t *_desc_module_remove(void *) {
 
 	);
 }
-}
\ No newline at end of file
+
+const led_graph_t *coordinates_graph_acquire(unsigned k, coord_c_t radius) {
+	if (radius <= 0) {
+		if (k < 1) {
+			RESPOND(E) << "neighbour graph requires a neighbour count or radius"
+								 << alp::over;
+			return nullptr;
+		}
+		radius = 0;
+	}
+	for (auto &graph : _Graphs) {
+		if ((graph->k == k) && (graph->radius == radius)) {
+			graph->refs++;
+			if (graph->stale()) _BuildGraph(*graph);
+			return &graph->view;
+		}
+	}
+
+	auto graph    = std::make_unique<Graph>();
+	graph->k      = k;
+	graph->radius = radius;
+	_BuildGraph(*graph);
+	_Graphs.emplace_back(std::move(graph));
+	return &_Graphs.back()->view;
+}
+
+const led_graph_t *coordinates_graph_refresh(const led_graph_t *view) {
+	for (auto &graph : _Graphs) {
+		if (&graph->view != view) continue;
+		if (graph->stale()) _BuildGraph(*graph);
+		return view;
+	}
+	return nullptr;
+}
+
+void coordinates_graph_release(const led_graph_t *view) {
+	for (auto it = _Graphs.begin(); it != _Graphs.end(); ++it) {
+		if (&(*it)->view != view) continue;
+		if (--(*it)->refs < 1) _Graphs.erase(it);
+		return;
+	}
+}
+}
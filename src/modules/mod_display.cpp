@@ -33,6 +33,8 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "modules/coordinates_api.h"
 #include "types/stringlist.h"
 #include "util/module.hpp"
+#include "util/spatial.hpp"
+#include <chrono>
 #include <compare>
 #include <cstdlib>
 #include <cstring>
@@ -41,14 +43,19 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include <sstream>
 #include <stdio.h>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 struct Anim;
 struct BlendAnimation;
+struct ModifierChain;
 
 static bool _AnimationsDirty = false;
 static bool _Dirty           = false;
 
+// bumped whenever blend geometry (LED sets or coordinates) may be stale
+static unsigned _GeometryGeneration = 0;
+
 struct Anim {
 	animno_t animno;
 	animno_t newAnimno = INVALID_ANIMATION;
@@ -59,6 +66,10 @@ struct Anim {
 	bool ledsDirty   = false;
 	bool animnoDirty = false;
 
+	// set while animno refers to a blend or modifier chain, for status reporting
+	BlendAnimation *blend = nullptr;
+	ModifierChain * chain = nullptr;
+
 	void replaceAnimno(animno_t no) {
 		newAnimno        = no;
 		animnoDirty      = true;
@@ -72,19 +83,30 @@ struct Anim {
 };
 
 struct Blender {
-	basemodno_t    blend_basemodno;
-	blend_init_f   blend_init;
-	blend_deinit_f blend_deinit;
-	blend_mix_f    blend_mix;
-	void *         blend_userdata = nullptr;
-
-	Blender(basemodno_t blend_basemodno, const std::string &argstr) :
-		blend_basemodno(blend_basemodno) {
+	std::string     name;
+	basemodno_t     blend_basemodno;
+	blend_init_f    blend_init;
+	blend_deinit_f  blend_deinit;
+	blend_prepare_f blend_prepare;
+	blend_mix_f     blend_mix;
+	void *          blend_userdata = nullptr;
+
+	// time of the last mix. A blender is shared by all pieces of a blend (and
+	// by flattened successors), so it must only advance once per frame.
+	double tFrameLast = -1;
+
+	Blender(
+		const std::string &name,
+		basemodno_t        blend_basemodno,
+		const std::string &argstr) :
+		name(name), blend_basemodno(blend_basemodno) {
 		basemodule_grab(blend_basemodno);
 		blend_init = reinterpret_cast<blend_init_f>(
 			basemodule_resolve(blend_basemodno, "init"));
 		blend_deinit = reinterpret_cast<blend_deinit_f>(
 			basemodule_resolve(blend_basemodno, "deinit"));
+		blend_prepare = reinterpret_cast<blend_prepare_f>(
+			basemodule_resolve(blend_basemodno, "prepare"));
 		blend_mix =
 			reinterpret_cast<blend_mix_f>(basemodule_resolve(blend_basemodno, "mix"));
 
@@ -102,45 +124,123 @@ struct Blender {
 	}
 
 	~Blender() { basemodule_drop(blend_basemodno); }
+
+	blend_state_t mix(
+		const led_i_t *ledv,
+		size_t         ledn,
+		led_t *        accum,
+		const led_t *  op2,
+		const float *  geometry,
+		frame_time_t   dt,
+		frame_time_t   t) {
+		// advance once per frame, even if mixed for several animations or LED
+		// ranges rendered for different times
+		const double tFrame = frame_anim_time();
+		if (tFrame == tFrameLast) {
+			dt = 0;
+		} else {
+			tFrameLast = tFrame;
+		}
+		return blend_mix(ledv, ledn, accum, op2, geometry, dt, t, blend_userdata);
+	}
 };
 
+// A blend over any number of animations. The first operand is rendered as-is,
+// every following operand is mixed on top of the accumulated result using its
+// blender. Once an operand's blend is done, all operands below it no longer
+// contribute and are dropped.
 struct BlendAnimation {
-	std::shared_ptr<Anim> anim1;
-	std::shared_ptr<Anim> anim2;
-
-	std::shared_ptr<Blender> blender;
-
-	std::shared_ptr<Anim> self = nullptr;
-
+	struct Operand {
+		std::shared_ptr<Anim>    anim;
+		std::shared_ptr<Blender> blender; // nullptr for the first operand
+
+		// blend_prepare output, valid for geometryLEDs
+		std::vector<float>   geometry           = {};
+		std::vector<led_i_t> geometryLEDs       = {};
+		unsigned             geometryGeneration = 0;
+		bool                 geometryValid      = false;
+
+		Operand(std::shared_ptr<Anim> anim, std::shared_ptr<Blender> blender) :
+			anim(anim), blender(blender) {}
+		Operand(const Operand &other) :
+			anim(other.anim), blender(other.blender) {}
+	};
+
+	std::vector<Operand> operands;
+
+	// operands dropped while rendering, released during flush as releasing a
+	// blender may unload its module
+	std::vector<Operand> retired;
+
+	// weak, as the Anim is reclaimed once no tier references it any more, e.g.
+	// after its operands were taken over by a newer blend
+	std::weak_ptr<Anim> self;
+
+	// dense results, indexed like ledv
+	std::vector<led_t> accum  = {};
 	std::vector<led_t> buffer = {};
 
-	BlendAnimation(
-
-		std::shared_ptr<Anim>    anim1,
-		std::shared_ptr<Anim>    anim2,
-		std::shared_ptr<Blender> blender) :
-		anim1(anim1), anim2(anim2), blender(blender) {}
+	BlendAnimation(std::vector<Operand> &&operands) :
+		operands(std::move(operands)) {}
 
 	~BlendAnimation() {}
 
 	void
 	iterate(const led_i_t *ledv, size_t ledn, frame_time_t dt, frame_time_t t) {
-		led_t *raw = frame_raw_anim();
-		anim_render(anim1->animno, ledv, ledn, dt, t);
-
-		// save op1 result
+		accum.resize(ledn);
 		buffer.resize(ledn);
-		for (size_t i = 0; i < ledn; i++) {
-			buffer[i] = raw[ledv[i]];
+
+		anim_render_to(operands[0].anim->animno, ledv, ledn, accum.data(), dt, t);
+
+		size_t iFirstActive = 0;
+		// the first operand's blender (if any) has finished already
+		for (size_t i = 1; i < operands.size(); i++) {
+			auto &op = operands[i];
+			anim_render_to(op.anim->animno, ledv, ledn, buffer.data(), dt, t);
+
+			if (!op.blender->blend_mix) {
+				std::swap(accum, buffer);
+				iFirstActive = i;
+				continue;
+			}
+
+			if (
+				!op.geometryValid || op.geometryLEDs.size() != ledn
+				|| op.geometryGeneration != _GeometryGeneration
+				|| (ledn > 0
+						&& std::memcmp(op.geometryLEDs.data(), ledv, ledn * sizeof(led_i_t))
+								 != 0)) {
+				op.geometry.resize(ledn);
+				op.geometryLEDs.assign(ledv, ledv + ledn);
+				if (op.blender->blend_prepare) {
+					op.blender->blend_prepare(
+						ledv, ledn, op.geometry.data(), op.blender->blend_userdata);
+				}
+				op.geometryGeneration = _GeometryGeneration;
+				op.geometryValid      = true;
+			}
+
+			blend_state_t state = op.blender->mix(
+				ledv, ledn, buffer.data(), accum.data(), op.geometry.data(), dt, t);
+
+			std::swap(accum, buffer);
+			if (state) iFirstActive = i;
 		}
 
-		// compute op2
-		anim_render(anim2->animno, ledv, ledn, dt, t);
+		led_t *raw = frame_raw_anim();
+		for (size_t i = 0; i < ledn; i++) {
+			raw[ledv[i]] = accum[i];
+		}
 
-		if (blender->blend_mix) {
-			if (blender->blend_mix(
-						ledv, ledn, raw, buffer.data(), dt, t, blender->blend_userdata)) {
-				self->replaceAnimno(anim2->animno);
+		if (iFirstActive > 0) {
+			retired.insert(
+				retired.end(), operands.begin(), operands.begin() + iFirstActive);
+			operands.erase(operands.begin(), operands.begin() + iFirstActive);
+			_AnimationsDirty = true;
+			if (operands.size() == 1) {
+				if (auto anim = self.lock()) {
+					anim->replaceAnimno(operands[0].anim->animno);
+				}
 			}
 		}
 	}
@@ -162,6 +262,382 @@ struct BlendAnimation {
 
 static std::vector<std::shared_ptr<Anim>> _Animations;
 
+static std::shared_ptr<Anim> _TrackAnim(animno_t animno, const LEDSet &leds) {
+	auto anim = std::make_shared<Anim>(animno, leds);
+	_Animations.push_back(anim);
+	anim_grab(animno);
+	return anim;
+}
+
+// Renders an animation at one representative LED per spatial cell and fills
+// in the remaining LEDs from the nearest representatives, either copying the
+// closest one or weighting the closest few by inverse squared distance.
+// Every few frames the animation is also evaluated at all LEDs to measure the
+// colour error, and the cell size adapts to keep it within the budget.
+struct LevelOfDetail {
+	static constexpr size_t   Neighbors      = 4;
+	static constexpr unsigned ReferenceEvery = 50; // frames
+
+	float budget; // mean absolute error per channel
+	bool  interpolate;
+
+	float cell  = 0; // 0 until derived from the LED extent
+	float limit = 0; // smallest cell size known to exceed the budget
+
+	std::vector<led_i_t>  ledsMapped = {};
+	uint32_t              version    = 0;
+	bool                  rebuild    = true;
+	bool                  passthrough = false;
+	std::vector<led_i_t>  reps       = {};
+	std::vector<uint32_t> source     = {}; // Neighbors entries per LED
+	std::vector<float>    weight     = {};
+	std::vector<led_t>    repColors  = {};
+	std::vector<led_t>    reference  = {};
+	unsigned              frame      = 0;
+
+	// results of the last reference evaluation
+	double lodNanoseconds  = 0;
+	double fullNanoseconds = 0;
+	double error           = 0;
+	double maxError        = 0;
+
+	LevelOfDetail(float budget, bool interpolate) :
+		budget(budget), interpolate(interpolate) {}
+
+	void build(const led_i_t *ledv, size_t ledn) {
+		const led_coord_data_t *coords = coordinates_raw_anim();
+		reps.clear();
+		source.clear();
+		weight.clear();
+		passthrough = true;
+		if (ledn < 2 || !coords) return;
+
+		if (!(cell > 0)) {
+			float lo[3], hi[3];
+			for (int a = 0; a < 3; a++) {
+				lo[a] = hi[a] = (&coords[ledv[0]].pos.x)[a];
+			}
+			for (size_t i = 1; i < ledn; i++) {
+				const float *p = &coords[ledv[i]].pos.x;
+				for (int a = 0; a < 3; a++) {
+					lo[a] = std::min(lo[a], p[a]);
+					hi[a] = std::max(hi[a], p[a]);
+				}
+			}
+			const float extent =
+				std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+			if (!(extent > 0)) return;
+			// start out with roughly 8 LEDs per cell
+			cell = extent / std::max(1.0f, std::cbrt(ledn / 8.0f));
+		}
+
+		// pick the LED closest to each occupied cell's center
+		struct Cluster {
+			size_t index;
+			float  d2;
+		};
+		std::unordered_map<uint64_t, Cluster> clusters;
+		const float                           inv = 1.0f / cell;
+		for (size_t i = 0; i < ledn; i++) {
+			const float *p = &coords[ledv[i]].pos.x;
+			uint64_t     key = 0;
+			float        d2  = 0;
+			for (int a = 0; a < 3; a++) {
+				const float f = std::floor(p[a] * inv);
+				const float d = p[a] - (f + 0.5f) * cell;
+				d2 += d * d;
+				key = key * 2097152 + (uint64_t)((int64_t)f & 0x1fffff);
+			}
+			auto it = clusters.find(key);
+			if (it == clusters.end()) {
+				clusters.emplace(key, Cluster{i, d2});
+			} else if (d2 < it->second.d2) {
+				it->second = {i, d2};
+			}
+		}
+		if (clusters.size() * 10 >= ledn * 9) return;
+
+		std::vector<size_t> repIndices;
+		repIndices.reserve(clusters.size());
+		for (const auto &it : clusters) repIndices.push_back(it.second.index);
+		std::sort(repIndices.begin(), repIndices.end());
+
+		std::vector<float> xyz;
+		reps.reserve(repIndices.size());
+		xyz.reserve(repIndices.size() * 3);
+		for (auto i : repIndices) {
+			reps.push_back(ledv[i]);
+			const float *p = &coords[ledv[i]].pos.x;
+			xyz.insert(xyz.end(), p, p + 3);
+		}
+		SpatialGrid grid;
+		grid.build(xyz.data(), reps.size(), 3);
+
+		const size_t neighbors = interpolate ? Neighbors : 1;
+		source.assign(ledn * Neighbors, 0);
+		weight.assign(ledn * Neighbors, 0);
+		std::vector<SpatialGrid::index_t> found;
+		for (size_t i = 0; i < ledn; i++) {
+			const float *p = &coords[ledv[i]].pos.x;
+			found.clear();
+			grid.nearest(p, neighbors, found);
+
+			float w[Neighbors], sum = 0;
+			for (size_t k = 0; k < found.size(); k++) {
+				const float *q     = xyz.data() + found[k] * 3;
+				const float  d[3]  = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+				const float  dist2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+				if (dist2 < 1e-12f) {
+					// coincides with a representative
+					std::fill(w, w + k, 0.0f);
+					w[k] = sum = 1;
+					for (size_t j = k + 1; j < found.size(); j++) w[j] = 0;
+					break;
+				}
+				w[k] = 1.0f / dist2;
+				sum += w[k];
+			}
+			for (size_t k = 0; k < found.size(); k++) {
+				source[i * Neighbors + k] = found[k];
+				weight[i * Neighbors + k] = w[k] / sum;
+			}
+		}
+		repColors.resize(reps.size());
+		passthrough = false;
+	}
+
+	// renders animno at ledv into dst, with dt and t as passed to iterate.
+	// Reference evaluations call the animation a second time per frame with a
+	// zero dt, so animations integrating dt are not advanced twice.
+	void render(
+		animno_t       animno,
+		const led_i_t *ledv,
+		size_t         ledn,
+		led_t *        dst,
+		frame_time_t   dt,
+		frame_time_t   t) {
+		const uint32_t v = coordinates_version();
+		if (
+			rebuild || version != v || ledsMapped.size() != ledn
+			|| (ledn > 0
+					&& std::memcmp(ledsMapped.data(), ledv, ledn * sizeof(led_i_t))
+							 != 0)) {
+			if (version != v || ledsMapped.size() != ledn) limit = 0;
+			ledsMapped.assign(ledv, ledv + ledn);
+			version = v;
+			rebuild = false;
+			build(ledv, ledn);
+		}
+
+		if (passthrough) {
+			anim_render_to(animno, ledv, ledn, dst, dt, t);
+			lodNanoseconds = fullNanoseconds;
+			error = maxError = 0;
+			// see whether coarser cells would stay within the budget after all
+			if (++frame % ReferenceEvery == 0 && cell > 0) adapt(1.25f);
+			return;
+		}
+
+		auto t0 = std::chrono::steady_clock::now();
+		anim_render_to(animno, reps.data(), reps.size(), repColors.data(), dt, t);
+		const float *   w   = weight.data();
+		const uint32_t *src = source.data();
+		for (size_t i = 0; i < ledn; i++, w += Neighbors, src += Neighbors) {
+			led_t c = {0, 0, 0};
+			for (size_t k = 0; k < Neighbors; k++) {
+				const led_t &r = repColors[src[k]];
+				c.r += r.r * w[k];
+				c.g += r.g * w[k];
+				c.b += r.b * w[k];
+			}
+			dst[i] = c;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+
+		if (++frame % ReferenceEvery != 0) return;
+
+		reference.resize(ledn);
+		anim_render_to(animno, ledv, ledn, reference.data(), 0, t);
+		auto t2 = std::chrono::steady_clock::now();
+
+		lodNanoseconds =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		fullNanoseconds =
+			std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+		double sum = 0;
+		maxError   = 0;
+		for (size_t i = 0; i < ledn; i++) {
+			const double e = std::fabs(dst[i].r - reference[i].r)
+											 + std::fabs(dst[i].g - reference[i].g)
+											 + std::fabs(dst[i].b - reference[i].b);
+			sum += e;
+			maxError = std::max(maxError, e / 3);
+		}
+		error = sum / (3 * ledn);
+
+		if (error > budget) {
+			limit = limit > 0 ? std::min(limit, cell) : cell;
+			adapt(0.75f);
+		} else if (error < budget / 2) {
+			adapt(1.25f);
+		}
+	}
+
+	void adapt(float factor) {
+		float next = cell * factor;
+		if (factor > 1 && limit > 0) next = std::min(next, limit * 0.95f);
+		if (std::fabs(next - cell) < cell * 0.01f) return;
+		cell    = next;
+		rebuild = true;
+	}
+
+	size_t representatives(size_t ledn) const {
+		return passthrough ? ledn : reps.size();
+	}
+};
+
+// An animation passed through a sequence of modifiers. The source and any
+// operand animations are rendered into dense buffers first, then all
+// modifiers are applied in order within a single pass over the LEDs.
+struct ModifierChain {
+	struct Modifier {
+		enum Kind {
+			Gain,
+			Hue,
+			Speed,
+			Mask,
+			Add,
+			Multiply,
+			Lod,
+			LodNearest
+		} kind = Gain;
+
+		float                 value = 1;
+		float                 matrix[9]; // hue rotation
+		LEDSet                mask;
+		std::vector<uint8_t>  inside = {}; // mask, indexed like ledv
+		std::shared_ptr<Anim> operand;
+		std::vector<led_t>    buffer = {};
+		std::string           operandName;
+		std::string           operandArgs;
+
+		static const char *Name(Kind kind) {
+			static const char *names[] = {
+				"gain", "hue", "speed", "mask", "add", "multiply", "lod", "lod_nearest"};
+			return names[kind];
+		}
+
+		void setHue(float degrees) {
+			// rotation about the grey axis
+			const float a = degrees * (float)(M_PI / 180);
+			const float c = cosf(a), s = sinf(a);
+			const float k = (1 - c) / 3, r = sqrtf(1.0f / 3) * s;
+			const float m[9] = {
+				c + k, k - r, k + r, k + r, c + k, k - r, k - r, k + r, c + k};
+			std::memcpy(matrix, m, sizeof(m));
+		}
+	};
+
+	std::shared_ptr<Anim> source;
+	std::vector<Modifier> modifiers;
+	float                 timeScale = 1;
+
+	std::unique_ptr<LevelOfDetail> lod;
+
+	std::vector<led_t>   accum      = {};
+	std::vector<led_i_t> ledsMasked = {};
+
+	void updateMasks(const led_i_t *ledv, size_t ledn) {
+		if (
+			ledsMasked.size() == ledn
+			&& (ledn < 1
+					|| std::memcmp(ledsMasked.data(), ledv, ledn * sizeof(led_i_t))
+							 == 0)) {
+			return;
+		}
+		ledsMasked.assign(ledv, ledv + ledn);
+		for (auto &mod : modifiers) {
+			if (mod.kind != Modifier::Mask) continue;
+			mod.inside.resize(ledn);
+			for (size_t i = 0; i < ledn; i++) {
+				mod.inside[i] =
+					std::binary_search(mod.mask.begin(), mod.mask.end(), ledv[i]);
+			}
+		}
+	}
+
+	void
+	iterate(const led_i_t *ledv, size_t ledn, frame_time_t dt, frame_time_t t) {
+		dt *= timeScale;
+		t *= timeScale;
+
+		accum.resize(ledn);
+		if (lod) {
+			lod->render(source->animno, ledv, ledn, accum.data(), dt, t);
+		} else {
+			anim_render_to(source->animno, ledv, ledn, accum.data(), dt, t);
+		}
+		for (auto &mod : modifiers) {
+			if (!mod.operand) continue;
+			mod.buffer.resize(ledn);
+			anim_render_to(mod.operand->animno, ledv, ledn, mod.buffer.data(), dt, t);
+		}
+		updateMasks(ledv, ledn);
+
+		led_t *raw = frame_raw_anim();
+		for (size_t i = 0; i < ledn; i++) {
+			led_t c = accum[i];
+			for (const auto &mod : modifiers) {
+				switch (mod.kind) {
+					case Modifier::Gain:
+						c.r *= mod.value;
+						c.g *= mod.value;
+						c.b *= mod.value;
+						break;
+					case Modifier::Hue: {
+						const float *m = mod.matrix;
+						c              = {
+              m[0] * c.r + m[1] * c.g + m[2] * c.b,
+              m[3] * c.r + m[4] * c.g + m[5] * c.b,
+              m[6] * c.r + m[7] * c.g + m[8] * c.b};
+					} break;
+					case Modifier::Speed:
+					case Modifier::Lod:
+					case Modifier::LodNearest: break;
+					case Modifier::Mask:
+						if (!mod.inside[i]) c = {0, 0, 0};
+						break;
+					case Modifier::Add:
+						c.r += mod.buffer[i].r;
+						c.g += mod.buffer[i].g;
+						c.b += mod.buffer[i].b;
+						break;
+					case Modifier::Multiply:
+						c.r *= mod.buffer[i].r;
+						c.g *= mod.buffer[i].g;
+						c.b *= mod.buffer[i].b;
+						break;
+				}
+			}
+			raw[ledv[i]] = c;
+		}
+	}
+
+	static void iterate(
+		const led_i_t *ledv,
+		size_t         ledn,
+		void *         ud,
+		frame_time_t   dt,
+		frame_time_t   t) {
+		((ModifierChain *)ud)->iterate(ledv, ledn, dt, t);
+	}
+	static void deinit(void *ud) {
+		_AnimationsDirty = true;
+
+		delete (ModifierChain *)ud;
+	}
+};
+
 struct Tier {
 	std::string                        name;
 	unsigned                           priority_major = 0;
@@ -211,11 +687,13 @@ struct Tier {
 
 	void blendTo(
 		std::shared_ptr<Anim> targetAnim,
+		const std::string &   blendName,
 		basemodno_t           blend_basemodno,
 		const std::string &   blendArgs) {
 		auto                               leds = targetAnim->leds;
 		std::vector<std::shared_ptr<Anim>> newAnims;
-		auto blender = std::make_shared<Blender>(blend_basemodno, blendArgs);
+		auto blender =
+			std::make_shared<Blender>(blendName, blend_basemodno, blendArgs);
 
 		for (auto it = anims.begin(); it != anims.end();) {
 			Anim & anim = **it;
@@ -235,7 +713,19 @@ struct Tier {
 
 			leds -= ledsBlending;
 			{
-				auto     blendAnim = new BlendAnimation(*it, targetAnim, blender);
+				// flatten running blends instead of nesting them
+				std::vector<BlendAnimation::Operand> operands;
+				if (anim.blend) {
+					operands.insert(
+						operands.end(),
+						anim.blend->operands.begin(),
+						anim.blend->operands.end());
+				} else {
+					operands.emplace_back(*it, nullptr);
+				}
+				operands.emplace_back(targetAnim, blender);
+
+				auto     blendAnim = new BlendAnimation(std::move(operands));
 				animno_t animno    = anim_define(
           "blend",
           BlendAnimation::iterate,
@@ -248,6 +738,7 @@ struct Tier {
 					delete blendAnim;
 				} else {
 					auto anim = std::make_shared<Anim>(animno, std::move(ledsBlending));
+					anim->blend     = blendAnim;
 					blendAnim->self = anim;
 					_Animations.push_back(anim);
 					anim_grab(animno);
@@ -310,7 +801,31 @@ void mod_display_status() {
 	auto msg = std::move(RESPOND(I) << "anims: " << _Animations.size() << "\n");
 	for (auto anim : _Animations) {
 		msg << "  anim " << anim->animno << " (" << anim->ledsActual.size() << "/"
-				<< anim->leds.size() << " leds)\n";
+				<< anim->leds.size() << " leds)";
+		if (anim->blend) {
+			msg << " blend";
+			for (const auto &op : anim->blend->operands) {
+				msg << " " << op.anim->animno;
+				if (op.blender) msg << "/" << op.blender->name;
+			}
+		}
+		if (anim->chain) {
+			msg << " " << anim->chain->source->animno;
+			for (const auto &mod : anim->chain->modifiers) {
+				msg << " with " << ModifierChain::Modifier::Name(mod.kind);
+				if (mod.operand) msg << " " << mod.operand->animno;
+			}
+			if (const auto &lod = anim->chain->lod) {
+				msg << ": " << lod->representatives(anim->leds.size()) << "/"
+						<< anim->leds.size() << " leds evaluated, speedup "
+						<< (lod->lodNanoseconds > 0
+									? lod->fullNanoseconds / lod->lodNanoseconds
+									: 1.0)
+						<< ", error " << lod->error << " mean " << lod->maxError
+						<< " max";
+			}
+		}
+		msg << "\n";
 	}
 	for (auto &tier : _Tierset) {
 		msg << "tier " << tier.name << " (" << tier.priority_major << "."
@@ -337,12 +852,17 @@ static void         _hook_ledsRemoved(hook_t, modno_t, void *) {
   }
   _AnimationsDirty = true;
 }
+static void _hook_coordinatesChanged(hook_t, modno_t, void *) {
+	_GeometryGeneration++;
+}
 
 void init(modno_t modno, const char *, void **) {
 	module_register_command(modno, "display", _cmd_display, _desc_display);
 	module_register_command(modno, "float", _cmd_float, _desc_float);
 	module_register_command(modno, "tier", _cmd_tier, _desc_tier);
 	module_hook(modno, hook_resolve("ledsRemoved"), _hook_ledsRemoved);
+	module_hook(
+		modno, hook_resolve("coordinatesChanged"), _hook_coordinatesChanged);
 }
 void deinit(modno_t, void *) {
 	_AnimationsDirty= false;
@@ -359,15 +879,19 @@ void flush(modno_t, void *) {
 				anim_drop((**it).animno);
 				it = _Animations.erase(it);
 			} else {
+				if ((**it).blend) (**it).blend->retired.clear();
 				if ((**it).ledsDirty) {
 					anim_restrict((**it).animno, (**it).leds.data(), (**it).leds.size());
 					(**it).ledsDirty = false;
+					_GeometryGeneration++;
 				}
 				if ((**it).animnoDirty) {
 					anim_grab((**it).newAnimno);
 					anim_drop((**it).animno);
 					(**it).animno      = (**it).newAnimno;
 					(**it).animnoDirty = false;
+					(**it).blend       = nullptr;
+					(**it).chain       = nullptr;
 				}
 				++it;
 			}
@@ -412,7 +936,8 @@ void flush(modno_t, void *) {
 
 					if (anim->ledsActual.empty()) continue;
 
-					anim_install(anim->animno);
+					anim_install_subset(
+						anim->animno, anim->ledsActual.data(), anim->ledsActual.size());
 				}
 				iTier++;
 			}
@@ -427,6 +952,112 @@ static uidl_node_t *_descTiers(const char *ident) {
 	return common_tier;
 }
 
+// parses the modifier following a display command's 'with' keyword
+static bool _ParseModifier(
+	alp::LineScanner &ln, std::vector<ModifierChain::Modifier> &modifiers) {
+	using Modifier = ModifierChain::Modifier;
+	std::string kind;
+	if (!ln.get(kind)) {
+		RESPOND(E) << "incomplete display command - modifier expected after 'with'"
+							 << alp::over;
+		return false;
+	}
+
+	Modifier mod;
+	if (kind == "gain" || kind == "hue" || kind == "speed") {
+		mod.kind = kind == "gain" ? Modifier::Gain
+							 : (kind == "hue" ? Modifier::Hue : Modifier::Speed);
+		if (!ln.get(mod.value)) {
+			RESPOND(E) << "incomplete display command - value expected after '"
+								 << kind << "'" << alp::over;
+			return false;
+		}
+		if (mod.kind == Modifier::Hue) mod.setHue(mod.value);
+	} else if (kind == "lod" || kind == "lod_nearest") {
+		mod.kind = kind == "lod" ? Modifier::Lod : Modifier::LodNearest;
+		if (!ln.get(mod.value) || !(mod.value > 0)) {
+			RESPOND(E) << "incomplete display command - positive error budget "
+										"expected after '"
+								 << kind << "'" << alp::over;
+			return false;
+		}
+		for (const auto &other : modifiers) {
+			if (other.kind == Modifier::Lod || other.kind == Modifier::LodNearest) {
+				RESPOND(E) << "only one level of detail modifier is supported"
+									 << alp::over;
+				return false;
+			}
+		}
+	} else if (kind == "mask") {
+		mod.kind = Modifier::Mask;
+		if (!display_processSelector(mod.mask, ln)) return false;
+	} else if (kind == "add" || kind == "multiply") {
+		mod.kind = kind == "add" ? Modifier::Add : Modifier::Multiply;
+		if (!ln.get(mod.operandName)) {
+			RESPOND(E) << "incomplete display command - animation name expected "
+										"after '"
+								 << kind << "'" << alp::over;
+			return false;
+		}
+	} else {
+		RESPOND(E) << "unknown modifier '" << kind << "'" << alp::over;
+		return false;
+	}
+	modifiers.push_back(std::move(mod));
+	return true;
+}
+
+// wraps an animation into a chain of modifiers, returning the chain's
+// animation
+static animno_t _ApplyModifiers(
+	animno_t                               animno,
+	const LEDSet &                         leds,
+	std::vector<ModifierChain::Modifier> &&modifiers,
+	ModifierChain *&                       chain) {
+	chain         = new ModifierChain();
+	chain->source = _TrackAnim(animno, leds);
+	for (auto &mod : modifiers) {
+		if (mod.kind == ModifierChain::Modifier::Speed) {
+			chain->timeScale *= mod.value;
+		}
+		if (
+			mod.kind == ModifierChain::Modifier::Lod
+			|| mod.kind == ModifierChain::Modifier::LodNearest) {
+			chain->lod = std::make_unique<LevelOfDetail>(
+				mod.value, mod.kind == ModifierChain::Modifier::Lod);
+		}
+		if (mod.operandName.empty()) continue;
+		animno_t operand = anim_init(
+			mod.operandName.c_str(),
+			leds.data(),
+			leds.size(),
+			mod.operandArgs.c_str());
+		if (INVALID_ANIMATION == operand) {
+			RESPOND(E) << "unable to init animation '" << mod.operandName << "'"
+								 << alp::over;
+			delete chain;
+			_AnimationsDirty = true;
+			return INVALID_ANIMATION;
+		}
+		mod.operand = _TrackAnim(operand, leds);
+	}
+	chain->modifiers = std::move(modifiers);
+
+	animno_t res = anim_define(
+		"modified",
+		ModifierChain::iterate,
+		ModifierChain::deinit,
+		(void *)chain,
+		leds.data(),
+		leds.size());
+	if (INVALID_ANIMATION == res) {
+		RESPOND(E) << "unable to define modified animation" << alp::over;
+		delete chain;
+		_AnimationsDirty = true;
+	}
+	return res;
+}
+
 static void _cmd_display(modno_t, const char *argstr, void *) {
 	alp::LineScanner ln(argstr);
 
@@ -441,6 +1072,10 @@ static void _cmd_display(modno_t, const char *argstr, void *) {
 	std::stringstream blendArgs;
 	std::string       blendName;
 
+	// arguments go to the animation, the blend or the last modifier's operand
+	std::vector<ModifierChain::Modifier> modifiers;
+	enum { ArgsAnim, ArgsBlend, ArgsOperand } args = ArgsAnim;
+
 	size_t      pos = ln.tell();
 	std::string cmd;
 
@@ -472,15 +1107,22 @@ static void _cmd_display(modno_t, const char *argstr, void *) {
 				}
 			} else if (cmd == "blend") {
 				blend = true;
+				args  = ArgsBlend;
 				if (!ln.get(blendName)) {
 					RESPOND(E)
 						<< "incomplete display command - blend module name expected"
 						<< alp::over;
 				}
-			} else if (blend) {
-				blendArgs << std::string_view(argstr + pos, ln.tell() - pos);
+			} else if (cmd == "with") {
+				if (!_ParseModifier(ln, modifiers)) return;
+				if (!modifiers.back().operandName.empty()) args = ArgsOperand;
 			} else {
-				animArgs << std::string_view(argstr + pos, ln.tell() - pos);
+				std::string_view arg(argstr + pos, ln.tell() - pos);
+				switch (args) {
+					case ArgsAnim: animArgs << arg; break;
+					case ArgsBlend: blendArgs << arg; break;
+					case ArgsOperand: modifiers.back().operandArgs += arg; break;
+				}
 			}
 			pos = ln.tell();
 		}
@@ -493,7 +1135,14 @@ static void _cmd_display(modno_t, const char *argstr, void *) {
 		return;
 	}
 
-	auto anim = std::make_shared<Anim>(animno, std::move(leds));
+	ModifierChain *chain = nullptr;
+	if (!modifiers.empty()) {
+		animno = _ApplyModifiers(animno, leds, std::move(modifiers), chain);
+		if (INVALID_ANIMATION == animno) return;
+	}
+
+	auto anim   = std::make_shared<Anim>(animno, std::move(leds));
+	anim->chain = chain;
 
 	auto tier = getTier(tierName, true);
 	if (nullptr == tier) {
@@ -510,7 +1159,7 @@ static void _cmd_display(modno_t, const char *argstr, void *) {
 			RESPOND(E) << "unable to find blend module " << blendName << alp::over;
 			tier->install(anim);
 		} else {
-			tier->blendTo(anim, bmod, blendArgs.str());
+			tier->blendTo(anim, blendName, bmod, blendArgs.str());
 		}
 		// std::shared_ptr<BlendModule> blendModule;
 		// if (!(blendModule = BlendRegistry().get(blendName))) {
@@ -536,6 +1185,17 @@ static uidl_node_t *_desc_display(void *) {
 	uidl_node_t *common_priority =
 		uidl_integer("display.priority", UIDL_LIMIT_LOWER, 0, 0);
 	uidl_node_t *common_blend = uidl_keyword("display.blend", 0);
+	uidl_node_t *common_with  = uidl_keyword(
+    "display.with",
+    8,
+    uidl_pair("gain", uidl_float(0, 0, 0, 0)),
+    uidl_pair("hue", uidl_float(0, 0, 0, 0)),
+    uidl_pair("speed", uidl_float(0, 0, 0, 0)),
+    uidl_pair("lod", uidl_float(0, 0, 0, 0)),
+    uidl_pair("lod_nearest", uidl_float(0, 0, 0, 0)),
+    uidl_pair("mask", uidl_reference("display.selector")),
+    uidl_pair("add", uidl_string(0, 0)),
+    uidl_pair("multiply", uidl_string(0, 0)));
 
 	bool first = true;
 
@@ -552,12 +1212,14 @@ static uidl_node_t *_desc_display(void *) {
 				uidl_keyword_set(subkw, "tier", common_tier);
 				uidl_keyword_set(subkw, "priority", common_priority);
 				uidl_keyword_set(subkw, "blend", common_blend);
+				uidl_keyword_set(subkw, "with", common_with);
 				first = false;
 			} else {
 				uidl_keyword_set(subkw, "on", uidl_reference("display.selector"));
 				uidl_keyword_set(subkw, "tier", uidl_reference("display.tier"));
 				uidl_keyword_set(subkw, "priority", uidl_reference("display.priority"));
 				uidl_keyword_set(subkw, "blend", uidl_reference("display.blend"));
+				uidl_keyword_set(subkw, "with", uidl_reference("display.with"));
 			}
 
 			uidl_keyword_set(res, ident.c_str(), uidl_repeat(nullptr, subkw, 0));
@@ -580,6 +1242,7 @@ static uidl_node_t *_desc_display(void *) {
 		uidl_node_free(common_tier);
 		uidl_node_free(common_priority);
 		uidl_node_free(common_blend);
+		uidl_node_free(common_with);
 	}
 	return res;
 }
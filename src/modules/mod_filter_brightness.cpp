@@ -21,17 +21,30 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "alpha4/common/logger.hpp"
 #include "alpha4/types/vector.hpp"
 #include "core/egress_api.h"
+#include "core/filter_api.h"
 #include "core/frame_api.h"
 #include "core/ledset.hpp"
 #include "core/module_api.h"
 #include "display_api.hpp"
 #include "modules/coordinates_api.h"
+#include "util/kernels.h"
 #include "util/module.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <stdio.h>
 #include <vector>
 
 static std::vector<float> _Brightness;
+static filterno_t         _Filter = INVALID_FILTER;
+
+// the filter only runs while any LED is dimmed
+static void _UpdateActive() {
+	filter_set_active(
+		_Filter,
+		std::any_of(_Brightness.begin(), _Brightness.end(), [](float b) {
+			return b != 1;
+		}));
+}
 
 extern "C" {
 
@@ -46,16 +59,11 @@ static void _hook_ledsRemoved(hook_t, modno_t, void *) {
 		_Brightness.begin() + egress_leds_removed_offset(),
 		_Brightness.begin()
 			+ (egress_leds_removed_offset() + egress_leds_removed_count()));
+	_UpdateActive();
 }
 
-static void _hook_applyFilter(hook_t, modno_t, void *) {
-	auto       leds = frame_raw_egress();
-	const auto ce   = frame_size();
-	for (size_t i = 0; i < ce; i++) {
-		leds[i].r *= _Brightness[i];
-		leds[i].g *= _Brightness[i];
-		leds[i].b *= _Brightness[i];
-	}
+static void _filter(led_t *leds, led_i_t first, size_t count, void *) {
+	led_scale(leds, _Brightness.data() + first, count);
 }
 
 void init(modno_t modno, const char *, void **) {
@@ -63,11 +71,16 @@ void init(modno_t modno, const char *, void **) {
 		modno, "brightness", _cmd_brightness, _desc_brightness);
 	module_hook(modno, hook_resolve("ledsAdded"), _hook_ledsAdded);
 	module_hook(modno, hook_resolve("ledsRemoved"), _hook_ledsRemoved);
-	module_hook(modno, hook_resolve("applyFilter"), _hook_applyFilter);
+	_Filter = filter_register(modno, _filter, nullptr);
+	_UpdateActive();
+}
+void deinit(modno_t, void *) {
+	filter_remove(_Filter);
+	_Filter = INVALID_FILTER;
+	_Brightness.clear();
 }
-void deinit(modno_t, void *) { _Brightness.clear(); }
 
-static void _cmd_brightness(modno_t, const char *argstr, void *) {
+static void _parseBrightness(const char *argstr) {
 	alp::LineScanner ln(argstr);
 	while (!ln.eof()) {
 		LEDSet leds;
@@ -80,6 +93,11 @@ static void _cmd_brightness(modno_t, const char *argstr, void *) {
 	}
 }
 
+static void _cmd_brightness(modno_t, const char *argstr, void *) {
+	_parseBrightness(argstr);
+	_UpdateActive();
+}
+
 static uidl_node_t *_desc_brightness(void *) {
 	return uidl_repeat(
 		0,
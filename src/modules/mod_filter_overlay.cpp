@@ -16,124 +16,165 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 */
 
 
-
 #include "alpha4/common/linescanner.hpp"
 #include "alpha4/common/logger.hpp"
 #include "alpha4/types/vector.hpp"
 #include "core/egress_api.h"
+#include "core/filter_api.h"
 #include "core/frame_api.h"
 #include "core/ledset.hpp"
 #include "core/module_api.h"
 #include "display_api.hpp"
 #include "modules/coordinates_api.h"
 #include "util/module.hpp"
+#include "util/overlay.hpp"
+#include <algorithm>
 #include <cstdlib>
 #include <iterator>
+#include <memory>
 #include <stdio.h>
+#include <string>
 #include <vector>
 
-extern "C" {
-#include "alpha4c/common/math.h"
-}
-struct leda_t : public led_t {
-	float a;
+static SparseOverlay _Overlay;
+static filterno_t    _Filter = INVALID_FILTER;
+
+static void _UpdateActive() { filter_set_active(_Filter, !_Overlay.empty()); }
+
+// collects writes to ascending LEDs into contiguous spans
+struct SpanWriter {
+	led_i_t             first = 0;
+	std::vector<leda_t> values;
+
+	void put(led_i_t led, const leda_t &v) {
+		if (!values.empty() && led != first + values.size()) flush();
+		if (values.empty()) first = led;
+		values.push_back(v);
+	}
+	void flush() {
+		_Overlay.write(first, values.data(), values.size());
+		values.clear();
+	}
 };
-static std::vector<leda_t> _Overlay;
+
+// writes packed rgba8 or rgb8 pixels to the LEDs starting at first
+static void _WritePixels(
+	led_i_t first, const uint8_t *data, size_t size, size_t stride) {
+	const size_t available = frame_size() > first ? frame_size() - first : 0;
+	const size_t count     = std::min(size / stride, available);
+
+	std::vector<leda_t> values(count);
+	for (size_t i = 0; i < count; i++) {
+		values[i] = stride == 4 ? SparseOverlay::FromRGBA8(data + i * 4)
+								: SparseOverlay::FromRGB8(data + i * 3);
+	}
+	_Overlay.write(first, values.data(), values.size());
+}
+
+static bool _ReadFile(const std::string &fn, std::vector<uint8_t> &data) {
+	FILE *f = fopen(fn.c_str(), "rb");
+	if (!f) {
+		RESPOND(E) << "cannot open '" << fn << "'" << alp::over;
+		return false;
+	}
+	std::unique_ptr<FILE, decltype(&fclose)> guard(f, &fclose);
+
+	uint8_t buf[4096];
+	for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+		data.insert(data.end(), buf, buf + n);
+	}
+	return true;
+}
+
+static size_t _Stride(const std::string &format) {
+	if (format == "rgba") return 4;
+	if (format == "rgb") return 3;
+	RESPOND(E) << "unknown pixel format '" << format << "' - use rgba or rgb"
+						 << alp::over;
+	return 0;
+}
 
 extern "C" {
 
 modno_t             SingletonInstance = INVALID_MODULE;
 static void         _cmd_overlay(modno_t, const char *argstr, void *);
 static uidl_node_t *_desc_overlay(void *);
-static void         _hook_ledsAdded(hook_t, modno_t, void *) {
-  _Overlay.resize(_Overlay.size() + egress_leds_added_count(), {{0, 0, 0}, 1});
-}
+static void         _cmd_overlay_data(modno_t, const char *argstr, void *);
+static void         _cmd_overlay_load(modno_t, const char *argstr, void *);
+
 static void _hook_ledsRemoved(hook_t, modno_t, void *) {
-	_Overlay.erase(
-		_Overlay.begin() + egress_leds_removed_offset(),
-		_Overlay.begin()
-			+ (egress_leds_removed_offset() + egress_leds_removed_count()));
+	_Overlay.remove(egress_leds_removed_offset(), egress_leds_removed_count());
+	_UpdateActive();
 }
 
-static void _hook_applyFilter(hook_t, modno_t, void *) {
-	auto       leds = frame_raw_egress();
-	const auto ce   = frame_size();
-	for (size_t i = 0; i < ce; i++) {
-		float a   = _Overlay[i].a;
-		leds[i].r = leds[i].r * a + _Overlay[i].r;
-		leds[i].g = leds[i].g * a + _Overlay[i].g;
-		leds[i].b = leds[i].b * a + _Overlay[i].b;
-	}
+static void _filter(led_t *leds, led_i_t first, size_t count, void *) {
+	_Overlay.apply(leds, first, count);
 }
 
 void init(modno_t modno, const char *, void **) {
 	module_register_command(modno, "overlay", _cmd_overlay, _desc_overlay);
-	module_hook(modno, hook_resolve("ledsAdded"), _hook_ledsAdded);
+	module_register_command(
+		modno, "overlay_data", _cmd_overlay_data, nullptr);
+	module_register_command(
+		modno, "overlay_load", _cmd_overlay_load, nullptr);
 	module_hook(modno, hook_resolve("ledsRemoved"), _hook_ledsRemoved);
-	module_hook(modno, hook_resolve("applyFilter"), _hook_applyFilter);
+	_Filter = filter_register(modno, _filter, nullptr);
+	_UpdateActive();
+}
+void deinit(modno_t, void *) {
+	filter_remove(_Filter);
+	_Filter = INVALID_FILTER;
+	_Overlay.clear();
 }
-void deinit(modno_t, void *) { _Overlay.clear(); }
 
-static void _cmd_overlay(modno_t, const char *argstr, void *) {
+static void _parseOverlay(const char *argstr) {
 	alp::LineScanner ln(argstr);
+	SpanWriter       writer;
 	while (!ln.eof()) {
 		LEDSet leds;
-		if (!display_processSelector(leds, ln)) return;
+		if (!display_processSelector(leds, ln)) break;
 
 		std::string raw;
 		for (auto it = leds.begin(), end = leds.end(); it != end;) {
-			if (!ln.get(raw)) return;
+			if (!ln.get(raw)) break;
 
 			unsigned long count = 1;
 
 			if (raw == "clear") {
-				for (; it != end; ++it) {
-					_Overlay[*it] = {{0, 0, 0}, 1};
+				writer.flush();
+				for (auto first = it; it != end; first = it) {
+					// erase runs of consecutive LEDs at once
+					for (++it; it != end && *it == *(it - 1) + 1; ++it) {}
+					_Overlay.erase(*first, it - first);
 				}
 				break;
 			} else if (raw.front() == 'x') {
 				count = std::strtoul(raw.c_str() + 1, nullptr, 0);
-				if (!ln.get(raw)) return;
+				if (!ln.get(raw)) break;
 			} else if (raw == "skip") {
 				unsigned long skipCount = 0;
-				if (!ln.get(skipCount)) return;
+				if (!ln.get(skipCount)) break;
 				for (; (skipCount > 0) && (it != end); --skipCount, ++it) {}
 				continue;
 			}
 
 			leda_t v;
-			{
-				uint32_t rgba8 = std::strtoull(raw.c_str(), nullptr, 16);
-				if (raw.size() == 8) {
-					const float a = fclamp(((rgba8)&0xff) * (1.0f / 255.f));
-					v.r           = ((rgba8 >> 24) & 0xff) * (1.0f / 255.f) * a;
-					v.g           = ((rgba8 >> 16) & 0xff) * (1.0f / 255.f) * a;
-					v.b           = ((rgba8 >> 8) & 0xff) * (1.0f / 255.f) * a;
-					v.a           = 1.0 - a;
-				} else if (raw.size() == 6) {
-					v.r = ((rgba8 >> 16) & 0xff) * (1.0f / 255.f);
-					v.g = ((rgba8 >> 8) & 0xff) * (1.0f / 255.f);
-					v.b = ((rgba8 >> 0) & 0xff) * (1.0f / 255.f);
-					v.a = 0;
-				} else if (raw.size() == 4) {
-					const float a = fclamp(((rgba8)&0xf) * (1.0f / 15.f));
-					v.r           = ((rgba8 >> 12) & 0xf) * (1.0f / 15.f) * a;
-					v.g           = ((rgba8 >> 8) & 0xf) * (1.0f / 15.f) * a;
-					v.b           = ((rgba8 >> 4) & 0xf) * (1.0f / 15.f) * a;
-					v.a           = 1 - a;
-				} else if (raw.size() == 3) {
-					v.r = ((rgba8 >> 8) & 0xf) * (1.0f / 15.f);
-					v.g = ((rgba8 >> 4) & 0xf) * (1.0f / 15.f);
-					v.b = ((rgba8 >> 0) & 0xf) * (1.0f / 15.f);
-					v.a = 0;
-				}
+			if (!SparseOverlay::ParseHex(raw, v)) {
+				RESPOND(E) << "invalid overlay colour '" << raw << "'" << alp::over;
+				break;
 			}
 
 			for (; (count > 0) && (it != end); --count, ++it) {
-				_Overlay[*it] = v;
+				writer.put(*it, v);
 			}
 		}
 	}
+	writer.flush();
+}
+
+static void _cmd_overlay(modno_t, const char *argstr, void *) {
+	_parseOverlay(argstr);
+	_UpdateActive();
 }
 
 static uidl_node_t *_desc_overlay(void *) {
@@ -143,4 +184,49 @@ static uidl_node_t *_desc_overlay(void *) {
 			0, 2, display_describeSelector(0), uidl_repeat(0, uidl_string(0, 0), 0)),
 		0);
 }
-}
\ No newline at end of file
+
+static void _cmd_overlay_data(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("overlay_data", {
+		alp::LineScanner ln(argstr);
+		unsigned long    first = 0;
+		std::string      format;
+		std::string      payload;
+		if (!ln.getAll(first, format, payload)) {
+			RESPOND(E) << "usage: overlay_data <first led> rgba|rgb <base64 data>"
+								 << alp::over;
+			return;
+		}
+		const size_t stride = _Stride(format);
+		if (stride < 1) return;
+
+		std::vector<uint8_t> data;
+		if (!SparseOverlay::DecodeBase64(payload, data)) {
+			RESPOND(E) << "invalid base64 payload" << alp::over;
+			return;
+		}
+		_WritePixels(first, data.data(), data.size(), stride);
+		_UpdateActive();
+	});
+}
+
+static void _cmd_overlay_load(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("overlay_load", {
+		alp::LineScanner ln(argstr);
+		unsigned long    first = 0;
+		std::string      format;
+		std::string      fn;
+		if (!ln.getAll(first, format, fn)) {
+			RESPOND(E) << "usage: overlay_load <first led> rgba|rgb <file>"
+								 << alp::over;
+			return;
+		}
+		const size_t stride = _Stride(format);
+		if (stride < 1) return;
+
+		std::vector<uint8_t> data;
+		if (!_ReadFile(fn, data)) return;
+		_WritePixels(first, data.data(), data.size(), stride);
+		_UpdateActive();
+	});
+}
+}
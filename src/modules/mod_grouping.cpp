@@ -25,6 +25,7 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 #include "core/ledset.hpp"
 #include "core/module_api.h"
 #include "modules/coordinates_api.h"
+#include "modules/selector.hpp"
 #include "types/stringlist.h"
 #include "util/module.hpp"
 #include <cstdlib>
@@ -33,6 +34,20 @@ Freyr2. If not, see <https://www.gnu.org/licenses/>.
 
 static std::unordered_map<std::string, LEDSet> _Groups;
 
+// named selector expressions, evaluated on first use and cached until groups,
+// the LED layout or coordinates change
+struct NamedSelector {
+	std::string expression;
+	LEDSet      leds;
+	bool        valid      = false;
+	bool        evaluating = false;
+};
+static std::unordered_map<std::string, NamedSelector> _Selectors;
+
+static void _InvalidateSelectors() {
+	for (auto &it : _Selectors) it.second.valid = false;
+}
+
 extern "C" {
 
 modno_t SingletonInstance = INVALID_MODULE;
@@ -40,8 +55,11 @@ modno_t SingletonInstance = INVALID_MODULE;
 static void _cmd_group_add(modno_t, const char *argstr, void *);
 static void _cmd_group_remove(modno_t, const char *argstr, void *);
 static void _cmd_group_clear(modno_t, const char *argstr, void *);
+static void _cmd_selector_define(modno_t, const char *argstr, void *);
+static void _cmd_selector_clear(modno_t, const char *argstr, void *);
 
 static void _removeLEDs(led_i_t offset, led_i_t count) {
+	_InvalidateSelectors();
 	for (auto it = _Groups.begin(); it != _Groups.end();) {
 		it->second.adjustRemovedLEDs(offset, count);
 		if (it->second.empty()) {
@@ -56,23 +74,37 @@ static void _hook_ledsRemoved(hook_t, modno_t, void *) {
 	_removeLEDs(egress_leds_removed_offset(), egress_leds_removed_count());
 }
 
+static void _hook_invalidate(hook_t, modno_t, void *) { _InvalidateSelectors(); }
+
 void init(modno_t modno, const char *, void **) {
 	module_register_command(modno, "group_add", _cmd_group_add, nullptr);
 	module_register_command(modno, "group_remove", _cmd_group_remove, nullptr);
 	module_register_command(modno, "group_clear", _cmd_group_clear, nullptr);
+	module_register_command(
+		modno, "selector_define", _cmd_selector_define, nullptr);
+	module_register_command(
+		modno, "selector_clear", _cmd_selector_clear, nullptr);
 	module_hook(modno, hook_resolve("ledsRemoved"), _hook_ledsRemoved);
+	module_hook(modno, hook_resolve("ledsAdded"), _hook_invalidate);
+	module_hook(modno, hook_resolve("coordinatesChanged"), _hook_invalidate);
+}
+void deinit(modno_t, void *) {
+	_Groups.clear();
+	_Selectors.clear();
 }
-void deinit(modno_t, void *) { _Groups.clear(); }
 void flush(modno_t, void *) {}
 
 stringlist_t *group_list_get() {
 	auto res = stringlist_new();
 
-	res->count = _Groups.size();
+	res->count = _Groups.size() + _Selectors.size();
 	if (res->count > 0) {
 		res->modules = (char **)malloc(res->count * sizeof(char *));
 		char **p     = res->modules;
-		for (auto it : _Groups) {
+		for (auto &it : _Groups) {
+			*p++ = strdup(it.first.c_str());
+		}
+		for (auto &it : _Selectors) {
 			*p++ = strdup(it.first.c_str());
 		}
 	} else {
@@ -87,15 +119,37 @@ led_i_t group_get(const char *ident, const led_i_t **pbuffer) {
 		*pbuffer = it->second.data();
 		return it->second.size();
 	}
-	return 0;
+
+	auto it = _Selectors.find(ident);
+	if (it == _Selectors.end()) return 0;
+	auto &sel = it->second;
+	if (!sel.valid) {
+		if (sel.evaluating) {
+			RESPOND(E) << "selector '" << ident << "' refers to itself" << alp::over;
+			return 0;
+		}
+		sel.evaluating = true;
+		sel.leds.clear();
+		bool ok        = SelectorExpression(sel.expression.c_str()).evaluate(sel.leds);
+		sel.evaluating = false;
+		if (!ok) return 0;
+		sel.valid = true;
+	}
+
+	// selectors may legitimately be empty - hand out a valid pointer regardless
+	static const led_i_t none = 0;
+	*pbuffer = sel.leds.empty() ? &none : sel.leds.data();
+	return sel.leds.size();
 }
 
 void group_set(const char *ident, led_i_t first, led_i_t count) {
 	_Groups[ident].append(first, count);
+	_InvalidateSelectors();
 }
 
 void group_clear(const char *ident) {
 	if (auto it = _Groups.find(ident); it != _Groups.end()) { _Groups.erase(it); }
+	_InvalidateSelectors();
 }
 
 static void _cmd_group_add(modno_t, const char *argstr, void *) {
@@ -116,6 +170,7 @@ static void _cmd_group_add(modno_t, const char *argstr, void *) {
 				first += egress_offset(egress);
 
 				_Groups[idGroup].append(first, count);
+				_InvalidateSelectors();
 			},
 			argstr);
 	});
@@ -144,4 +199,56 @@ static void _cmd_group_clear(modno_t, const char *argstr, void *) {
 	MODULE_SAFECALL(
 		"group_clear", { alp::LineScanner::Call(group_clear, argstr); });
 }
-}
\ No newline at end of file
+
+static void _cmd_selector_define(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("selector_define", {
+		alp::LineScanner ln(argstr);
+		std::string_view name_v;
+		std::string_view expr_v;
+		if (!ln.getLnFirstString(name_v) || !ln.getLnRemainder(expr_v)) {
+			RESPOND(E) << "usage: selector_define <name> <expression>" << alp::over;
+			return;
+		}
+		std::string name(name_v);
+		if (_Groups.count(name) > 0) {
+			RESPOND(E) << "cannot define selector '" << name
+								 << "' - a group of that name exists" << alp::over;
+			return;
+		}
+
+		// a redefinition must not refer to the selector it replaces
+		auto old = _Selectors.find(name);
+		if (old != _Selectors.end()) {
+			old->second.valid      = false;
+			old->second.evaluating = true;
+		}
+
+		NamedSelector sel;
+		sel.expression = expr_v;
+		bool ok = SelectorExpression(sel.expression.c_str()).evaluate(sel.leds);
+		if (old != _Selectors.end()) old->second.evaluating = false;
+		if (!ok) return;
+		sel.valid = true;
+
+		_InvalidateSelectors();
+		_Selectors[name] = std::move(sel);
+		RESPOND(I) << "selector '" << name << "': " << _Selectors[name].leds.size()
+							 << " LEDs" << alp::over;
+	});
+}
+
+static void _cmd_selector_clear(modno_t, const char *argstr, void *) {
+	MODULE_SAFECALL("selector_clear", {
+		alp::LineScanner::Call(
+			[&](const std::string &name) -> void {
+				if (_Selectors.erase(name) < 1) {
+					RESPOND(E) << "selector '" << name << "' does not exist"
+										 << alp::over;
+					return;
+				}
+				_InvalidateSelectors();
+			},
+			argstr);
+	});
+}
+}
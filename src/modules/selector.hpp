@@ -0,0 +1,201 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SELECTOR_HPP
+#define SELECTOR_HPP
+
+#include "core/frame_api.h"
+#include "core/ledset.hpp"
+#include "util/module.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+extern "C" {
+#include "coordinates_api.h"
+#include "grouping_api.h"
+}
+
+// Evaluates a selector expression into an LEDSet:
+//
+//   expr := term { ('|' | '&' | '-') term }
+//   term := '(' expr ')' | 'all' | N | N-M | name
+//         | 'voxel(' cx cy cz e [ey ez] ')' | 'sphere(' cx cy cz r ')'
+//         | 'halfspace(' px py pz nx ny nz ')'
+//
+// Operators are union, intersection and difference. They share one precedence
+// level and are applied left to right, so use parentheses to group. Ranges are
+// inclusive LED indices, names refer to groups or named selectors and function
+// arguments are separated by commas or whitespace.
+class SelectorExpression {
+protected:
+	const char *_expr;
+	const char *_p;
+
+	bool fail(const char *msg) {
+		RESPOND(E) << "invalid selector '" << _expr << "': " << msg << " at offset "
+							 << (_p - _expr) << alp::over;
+		return false;
+	}
+
+	void skip() {
+		while (isspace((unsigned char)*_p)) _p++;
+	}
+
+	static bool isNameStart(char c) { return isalpha((unsigned char)c) || c == '_'; }
+	static bool isNameChar(char c) {
+		return isalnum((unsigned char)c) || c == '_' || c == '.';
+	}
+
+	bool arguments(float *argv, size_t argmin, size_t argmax, size_t &argc) {
+		_p++;
+		for (argc = 0;; argc++) {
+			skip();
+			if (*_p == ',') {
+				_p++;
+				skip();
+			}
+			if (*_p == ')') break;
+			if (argc >= argmax) return fail("too many arguments");
+			char *end;
+			argv[argc] = strtof(_p, &end);
+			if (end == _p) return fail("expected number");
+			_p = end;
+		}
+		if (argc < argmin) return fail("too few arguments");
+		_p++;
+		return true;
+	}
+
+	bool function(const std::string &name, LEDSet &out) {
+		float          argv[6];
+		size_t         argc = 0;
+		const led_i_t *ptr  = nullptr;
+		size_t         n    = 0;
+
+		if (name == "voxel") {
+			if (!arguments(argv, 4, 6, argc)) return false;
+			if (argc == 5) return fail("voxel requires one or three extents");
+			coord_t center = {argv[0], argv[1], argv[2]};
+			coord_t extent = {argv[3], argv[3], argv[3]};
+			if (argc == 6) {
+				extent.y = argv[4];
+				extent.z = argv[5];
+			}
+			n = coordinates_query_box(&center, &extent, &ptr);
+		} else if (name == "sphere") {
+			if (!arguments(argv, 4, 4, argc)) return false;
+			coord_t center = {argv[0], argv[1], argv[2]};
+			n              = coordinates_query_sphere(&center, argv[3], &ptr);
+		} else if (name == "halfspace") {
+			if (!arguments(argv, 6, 6, argc)) return false;
+			coord_t point  = {argv[0], argv[1], argv[2]};
+			coord_t normal = {argv[3], argv[4], argv[5]};
+			n              = coordinates_query_halfspace(&point, &normal, &ptr);
+		} else {
+			return fail("unknown function");
+		}
+
+		out.append(ptr, n);
+		return true;
+	}
+
+	bool term(LEDSet &out) {
+		skip();
+		if (*_p == '(') {
+			_p++;
+			if (!expression(out)) return false;
+			skip();
+			if (*_p != ')') return fail("expected ')'");
+			_p++;
+			return true;
+		}
+
+		if (isdigit((unsigned char)*_p)) {
+			char *        end;
+			unsigned long first = strtoul(_p, &end, 10), last = first;
+			_p = end;
+			if (*_p == '-' && isdigit((unsigned char)_p[1])) {
+				last = strtoul(_p + 1, &end, 10);
+				_p   = end;
+				if (last < first) return fail("descending range");
+			}
+			const unsigned long size = frame_size();
+			if (first < size) {
+				last = std::min(last, size - 1);
+				out.append((led_i_t)first, (led_i_t)(last - first + 1));
+			}
+			return true;
+		}
+
+		if (!isNameStart(*_p)) return fail("expected term");
+		const char *start = _p;
+		while (isNameChar(*_p)) _p++;
+		std::string name(start, _p);
+
+		if (*_p == '(') return function(name, out);
+
+		if (name == "all") {
+			out.append((led_i_t)0, (led_i_t)frame_size());
+			return true;
+		}
+
+		const led_i_t *ptr = nullptr;
+		size_t         n   = group_get(name.c_str(), &ptr);
+		if (nullptr == ptr) {
+			_p = start;
+			return fail("no group or selector of that name");
+		}
+		out.append(ptr, n);
+		return true;
+	}
+
+	bool expression(LEDSet &out) {
+		if (!term(out)) return false;
+		for (;;) {
+			skip();
+			const char op = *_p;
+			if (op != '|' && op != '&' && op != '-') return true;
+			_p++;
+
+			LEDSet rhs;
+			if (!term(rhs)) return false;
+			switch (op) {
+				case '|': out += rhs; break;
+				case '&': out %= rhs; break;
+				case '-': out -= rhs; break;
+			}
+		}
+	}
+
+public:
+	SelectorExpression(const char *expr) : _expr(expr), _p(expr) {}
+
+	// evaluates the expression into out, responding with an error and returning
+	// false on syntax errors or unknown names
+	bool evaluate(LEDSet &out) {
+		_p = _expr;
+		LEDSet result;
+		if (!expression(result)) return false;
+		skip();
+		if (*_p != 0) return fail("unexpected character");
+		out += result;
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,166 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef UTIL_INTERLEAVE_H
+#define UTIL_INTERLEAVE_H
+#include "alpha4c/common/inline.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Byte interleaving across rows, e.g. strand buffers transmitted in lockstep:
+// out[i * nrows + r] = rows[r][i] for i < n and r < nrows. This is a byte
+// matrix transpose; 8 and 16 rows are transposed in blocks of 16 (SSE2) or
+// 32 (AVX2) columns via unpack cascades, other row counts and the remaining
+// columns are handled by the scalar loop.
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#ifdef __AVX2__
+typedef __m256i interleave_v;
+#define INTERLEAVE_LOAD(p)     _mm256_loadu_si256((const __m256i *)(p))
+#define INTERLEAVE_UNPACKLO(b) _mm256_unpacklo_epi##b
+#define INTERLEAVE_UNPACKHI(b) _mm256_unpackhi_epi##b
+#define INTERLEAVE_STORE(p, v, lanestride)                              \
+	do {                                                                  \
+		_mm_storeu_si128((__m128i *)(p), _mm256_castsi256_si128(v));       \
+		_mm_storeu_si128(                                                   \
+			(__m128i *)((p) + (lanestride)), _mm256_extracti128_si256(v, 1)); \
+	} while (0)
+#else
+typedef __m128i interleave_v;
+#define INTERLEAVE_LOAD(p)                 _mm_loadu_si128((const __m128i *)(p))
+#define INTERLEAVE_UNPACKLO(b)             _mm_unpacklo_epi##b
+#define INTERLEAVE_UNPACKHI(b)             _mm_unpackhi_epi##b
+#define INTERLEAVE_STORE(p, v, lanestride) _mm_storeu_si128((__m128i *)(p), v)
+#endif
+// columns per block; AVX2 unpacks operate on two independent 16 byte lanes,
+// the upper one yielding columns 16..31
+#define INTERLEAVE_BLOCK (sizeof(interleave_v))
+
+// transposes columns [i, i + INTERLEAVE_BLOCK) of 8 rows
+ALPHA4C_INLINE(void bytes_interleave_block8)
+(uint8_t *out, const uint8_t *const *rows, size_t i) {
+	interleave_v a[8], b[8];
+	for (int r = 0; r < 8; r++) a[r] = INTERLEAVE_LOAD(rows[r] + i);
+
+	// b[h * 4 + k]: rows 2k, 2k + 1 of columns 8h .. 8h + 7
+	for (int k = 0; k < 4; k++) {
+		b[k]     = INTERLEAVE_UNPACKLO(8)(a[2 * k], a[2 * k + 1]);
+		b[k + 4] = INTERLEAVE_UNPACKHI(8)(a[2 * k], a[2 * k + 1]);
+	}
+	// a[h * 4 + q * 2 + k]: rows 4k .. 4k + 3 of columns 8h + 4q .. 8h + 4q + 3
+	for (int h = 0; h < 2; h++) {
+		for (int k = 0; k < 2; k++) {
+			a[h * 4 + k] =
+				INTERLEAVE_UNPACKLO(16)(b[h * 4 + 2 * k], b[h * 4 + 2 * k + 1]);
+			a[h * 4 + 2 + k] =
+				INTERLEAVE_UNPACKHI(16)(b[h * 4 + 2 * k], b[h * 4 + 2 * k + 1]);
+		}
+	}
+	// all 8 rows of columns 8h + 4q, +1 (lo) and 8h + 4q + 2, +3 (hi)
+	uint8_t *o = out + i * 8;
+	for (int h = 0; h < 2; h++) {
+		for (int q = 0; q < 2; q++) {
+			const interleave_v lo =
+				INTERLEAVE_UNPACKLO(32)(a[h * 4 + q * 2], a[h * 4 + q * 2 + 1]);
+			const interleave_v hi =
+				INTERLEAVE_UNPACKHI(32)(a[h * 4 + q * 2], a[h * 4 + q * 2 + 1]);
+			INTERLEAVE_STORE(o + (8 * h + 4 * q) * 8, lo, 16 * 8);
+			INTERLEAVE_STORE(o + (8 * h + 4 * q + 2) * 8, hi, 16 * 8);
+		}
+	}
+}
+
+// transposes columns [i, i + INTERLEAVE_BLOCK) of 16 rows
+ALPHA4C_INLINE(void bytes_interleave_block16)
+(uint8_t *out, const uint8_t *const *rows, size_t i) {
+	interleave_v a[16], b[16];
+	for (int r = 0; r < 16; r++) a[r] = INTERLEAVE_LOAD(rows[r] + i);
+
+	// b[h * 8 + k]: rows 2k, 2k + 1 of columns 8h .. 8h + 7
+	for (int k = 0; k < 8; k++) {
+		b[k]     = INTERLEAVE_UNPACKLO(8)(a[2 * k], a[2 * k + 1]);
+		b[k + 8] = INTERLEAVE_UNPACKHI(8)(a[2 * k], a[2 * k + 1]);
+	}
+	// a[g * 4 + k]: rows 4k .. 4k + 3 of columns 4g .. 4g + 3
+	for (int h = 0; h < 2; h++) {
+		for (int k = 0; k < 4; k++) {
+			a[h * 8 + k] =
+				INTERLEAVE_UNPACKLO(16)(b[h * 8 + 2 * k], b[h * 8 + 2 * k + 1]);
+			a[h * 8 + 4 + k] =
+				INTERLEAVE_UNPACKHI(16)(b[h * 8 + 2 * k], b[h * 8 + 2 * k + 1]);
+		}
+	}
+	// b[g * 4 + p * 2 + m]: rows 8m .. 8m + 7 of columns 4g + 2p, +1
+	for (int g = 0; g < 4; g++) {
+		for (int m = 0; m < 2; m++) {
+			b[g * 4 + m] =
+				INTERLEAVE_UNPACKLO(32)(a[g * 4 + 2 * m], a[g * 4 + 2 * m + 1]);
+			b[g * 4 + 2 + m] =
+				INTERLEAVE_UNPACKHI(32)(a[g * 4 + 2 * m], a[g * 4 + 2 * m + 1]);
+		}
+	}
+	// all 16 rows of columns 4g + 2p (lo) and 4g + 2p + 1 (hi)
+	uint8_t *o = out + i * 16;
+	for (int g = 0; g < 4; g++) {
+		for (int p = 0; p < 2; p++) {
+			const interleave_v lo =
+				INTERLEAVE_UNPACKLO(64)(b[g * 4 + p * 2], b[g * 4 + p * 2 + 1]);
+			const interleave_v hi =
+				INTERLEAVE_UNPACKHI(64)(b[g * 4 + p * 2], b[g * 4 + p * 2 + 1]);
+			INTERLEAVE_STORE(o + (4 * g + 2 * p) * 16, lo, 16 * 16);
+			INTERLEAVE_STORE(o + (4 * g + 2 * p + 1) * 16, hi, 16 * 16);
+		}
+	}
+}
+#endif
+
+// out[i * nrows + r] = rows[r][i] for i < n and r < nrows
+ALPHA4C_INLINE(void bytes_interleave)
+(uint8_t *out, const uint8_t *const *rows, size_t nrows, size_t n) {
+	size_t i = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+	if (nrows == 8) {
+		for (; i + INTERLEAVE_BLOCK <= n; i += INTERLEAVE_BLOCK) {
+			bytes_interleave_block8(out, rows, i);
+		}
+	} else if (nrows == 16) {
+		for (; i + INTERLEAVE_BLOCK <= n; i += INTERLEAVE_BLOCK) {
+			bytes_interleave_block16(out, rows, i);
+		}
+	}
+#endif
+	for (uint8_t *o = out + i * nrows; i < n; i++) {
+		for (size_t r = 0; r < nrows; r++) *o++ = rows[r][i];
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
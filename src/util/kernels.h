@@ -0,0 +1,176 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTIL_KERNELS_H
+#define UTIL_KERNELS_H
+#include "alpha4c/common/inline.h"
+#include "core/frame_api.h"
+#include <stddef.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Kernels operating on dense LED buffers. led_t is three packed floats, so a
+// run of n LEDs is processed as 3n floats (buffers are expected to be float
+// aligned, as any heap-allocated LED buffer is). SSE2 paths handle 4 LEDs
+// (three vectors) per step, the scalar tail handles the rest.
+
+// accum[i] += (op[i] - accum[i]) * f
+ALPHA4C_INLINE(void led_lerp)
+(led_t *accum, const led_t *op, float f, size_t n) {
+	void *       va = accum;
+	const void * vo = op;
+	float *      pa = (float *)va;
+	const float *po = (const float *)vo;
+	size_t       i  = 0;
+#ifdef __SSE2__
+	const __m128 vf = _mm_set1_ps(f);
+	for (; i + 4 <= n; i += 4, pa += 12, po += 12) {
+		for (int k = 0; k < 12; k += 4) {
+			__m128 a = _mm_loadu_ps(pa + k);
+			__m128 o = _mm_loadu_ps(po + k);
+			_mm_storeu_ps(pa + k, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(o, a), vf)));
+		}
+	}
+#endif
+	for (; i < n; i++, pa += 3, po += 3) {
+		pa[0] += (po[0] - pa[0]) * f;
+		pa[1] += (po[1] - pa[1]) * f;
+		pa[2] += (po[2] - pa[2]) * f;
+	}
+}
+
+// accum[i] += (op[i] - accum[i]) * clamp((proj[i] - offset) * scale, 0, 1)
+ALPHA4C_INLINE(void led_lerp_ramp)
+(led_t *      accum,
+ const led_t *op,
+ const float *proj,
+ float        offset,
+ float        scale,
+ size_t       n) {
+	void *       va = accum;
+	const void * vo = op;
+	float *      pa = (float *)va;
+	const float *po = (const float *)vo;
+	size_t       i  = 0;
+#ifdef __SSE2__
+	const __m128 voff   = _mm_set1_ps(offset);
+	const __m128 vscale = _mm_set1_ps(scale);
+	const __m128 vzero  = _mm_setzero_ps();
+	const __m128 vone   = _mm_set1_ps(1.0f);
+	for (; i + 4 <= n; i += 4, pa += 12, po += 12) {
+		__m128 w = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(proj + i), voff), vscale);
+		w        = _mm_min_ps(_mm_max_ps(w, vzero), vone);
+
+		// expand (w0 w1 w2 w3) to match the rgb layout of 4 LEDs
+		__m128 wv[3] = {
+			_mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 0, 0, 0)),
+			_mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 1, 1)),
+			_mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 2))};
+		for (int k = 0; k < 3; k++) {
+			__m128 a = _mm_loadu_ps(pa + 4 * k);
+			__m128 o = _mm_loadu_ps(po + 4 * k);
+			_mm_storeu_ps(
+				pa + 4 * k, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(o, a), wv[k])));
+		}
+	}
+#endif
+	for (; i < n; i++, pa += 3, po += 3) {
+		float f = (proj[i] - offset) * scale;
+		f       = f < 0 ? 0 : (f > 1 ? 1 : f);
+		pa[0] += (po[0] - pa[0]) * f;
+		pa[1] += (po[1] - pa[1]) * f;
+		pa[2] += (po[2] - pa[2]) * f;
+	}
+}
+
+// leds[i] *= scale[i]
+ALPHA4C_INLINE(void led_scale)
+(led_t *leds, const float *scale, size_t n) {
+	void * vl = leds;
+	float *pl = (float *)vl;
+	size_t i  = 0;
+#ifdef __SSE2__
+	for (; i + 4 <= n; i += 4, pl += 12) {
+		const __m128 s     = _mm_loadu_ps(scale + i);
+		const __m128 sv[3] = {
+			_mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 0, 0)),
+			_mm_shuffle_ps(s, s, _MM_SHUFFLE(2, 2, 1, 1)),
+			_mm_shuffle_ps(s, s, _MM_SHUFFLE(3, 3, 3, 2))};
+		for (int k = 0; k < 3; k++) {
+			_mm_storeu_ps(pl + 4 * k, _mm_mul_ps(_mm_loadu_ps(pl + 4 * k), sv[k]));
+		}
+	}
+#endif
+	for (; i < n; i++, pl += 3) {
+		pl[0] *= scale[i];
+		pl[1] *= scale[i];
+		pl[2] *= scale[i];
+	}
+}
+
+// leds[i] = leds[i] * rgba[i].a + rgba[i].rgb, rgba holding four floats per
+// LED (the overlay colour premultiplied by its alpha, and one minus alpha)
+ALPHA4C_INLINE(void led_overlay)
+(led_t *leds, const float *rgba, size_t n) {
+	void * vl = leds;
+	float *pl = (float *)vl;
+	size_t i  = 0;
+#ifdef __SSE2__
+	for (; i + 4 <= n; i += 4, pl += 12, rgba += 16) {
+		const __m128 o0 = _mm_loadu_ps(rgba);
+		const __m128 o1 = _mm_loadu_ps(rgba + 4);
+		const __m128 o2 = _mm_loadu_ps(rgba + 8);
+		const __m128 o3 = _mm_loadu_ps(rgba + 12);
+
+		// regroup (r g b a) x 4 into the rgb layout of 4 LEDs, and the alphas
+		// to match
+		const __m128 b0r1 = _mm_shuffle_ps(o0, o1, _MM_SHUFFLE(0, 0, 2, 2));
+		const __m128 b2r3 = _mm_shuffle_ps(o2, o3, _MM_SHUFFLE(0, 0, 2, 2));
+		const __m128 a01  = _mm_shuffle_ps(o0, o1, _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128 a23  = _mm_shuffle_ps(o2, o3, _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128 cv[3] = {
+			_mm_shuffle_ps(o0, b0r1, _MM_SHUFFLE(2, 0, 1, 0)),
+			_mm_shuffle_ps(o1, o2, _MM_SHUFFLE(1, 0, 2, 1)),
+			_mm_shuffle_ps(b2r3, o3, _MM_SHUFFLE(2, 1, 2, 0))};
+		const __m128 av[3] = {
+			_mm_shuffle_ps(a01, a01, _MM_SHUFFLE(2, 0, 0, 0)),
+			_mm_shuffle_ps(a01, a23, _MM_SHUFFLE(0, 0, 2, 2)),
+			_mm_shuffle_ps(a23, a23, _MM_SHUFFLE(2, 2, 2, 0))};
+		for (int k = 0; k < 3; k++) {
+			const __m128 l = _mm_loadu_ps(pl + 4 * k);
+			_mm_storeu_ps(pl + 4 * k, _mm_add_ps(_mm_mul_ps(l, av[k]), cv[k]));
+		}
+	}
+#endif
+	for (; i < n; i++, pl += 3, rgba += 4) {
+		pl[0] = pl[0] * rgba[3] + rgba[0];
+		pl[1] = pl[1] * rgba[3] + rgba[1];
+		pl[2] = pl[2] * rgba[3] + rgba[2];
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
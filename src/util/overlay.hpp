@@ -0,0 +1,230 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTIL_OVERLAY_HPP
+#define UTIL_OVERLAY_HPP
+
+#include "core/frame_api.h"
+#include "util/kernels.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "alpha4c/common/math.h"
+}
+
+// overlay colour, premultiplied by its alpha, followed by the fraction of the
+// underlying LED that shows through, as blended by led_overlay
+struct leda_t : public led_t {
+	float a;
+};
+static_assert(sizeof(leda_t) == 4 * sizeof(float));
+
+// Overlay stored as sorted, disjoint runs of consecutive LEDs, so updates and
+// the filter pass only touch overlaid regions. Runs may contain transparent
+// entries, e.g. gaps between merged runs.
+class SparseOverlay {
+public:
+	static constexpr leda_t Transparent = {{0, 0, 0}, 1};
+
+	struct Run {
+		led_i_t             first;
+		std::vector<leda_t> values;
+
+		led_i_t end() const { return first + (led_i_t)values.size(); }
+	};
+
+protected:
+	std::vector<Run> _runs;
+
+	// first run ending at or after led
+	std::vector<Run>::iterator reaching(led_i_t led) {
+		return std::lower_bound(
+			_runs.begin(), _runs.end(), led, [](const Run &run, led_i_t led) {
+				return run.end() < led;
+			});
+	}
+
+public:
+	bool                    empty() const { return _runs.empty(); }
+	const std::vector<Run> &runs() const { return _runs; }
+	void                    clear() { _runs.clear(); }
+
+	size_t covered() const {
+		size_t n = 0;
+		for (const auto &run : _runs) n += run.values.size();
+		return n;
+	}
+
+	// overwrites count LEDs starting at first, merging touching runs
+	void write(led_i_t first, const leda_t *values, size_t count) {
+		if (count < 1) return;
+		const led_i_t last = first + (led_i_t)count;
+
+		auto lo = reaching(first);
+		auto hi = lo;
+		while (hi != _runs.end() && hi->first <= last) ++hi;
+		if (lo == hi) {
+			_runs.insert(lo, Run{first, std::vector<leda_t>(values, values + count)});
+			return;
+		}
+
+		const led_i_t merged = std::min(lo->first, first);
+		Run           run{merged, {}};
+		run.values.resize(std::max((hi - 1)->end(), last) - merged, Transparent);
+		for (auto it = lo; it != hi; ++it) {
+			std::copy(
+				it->values.begin(),
+				it->values.end(),
+				run.values.begin() + (it->first - merged));
+		}
+		std::copy(values, values + count, run.values.begin() + (first - merged));
+
+		*lo = std::move(run);
+		_runs.erase(lo + 1, hi);
+	}
+
+	// removes count LEDs starting at first from the overlay
+	void erase(led_i_t first, size_t count) {
+		if (count < 1) return;
+		const led_i_t last = first + (led_i_t)count;
+		for (auto it = reaching(first + 1); it != _runs.end() && it->first < last;) {
+			if (it->first < first && it->end() > last) {
+				// split
+				Run tail{
+					last,
+					std::vector<leda_t>(
+						it->values.begin() + (last - it->first), it->values.end())};
+				it->values.resize(first - it->first);
+				_runs.insert(it + 1, std::move(tail));
+				return;
+			}
+			if (it->first >= first && it->end() <= last) {
+				it = _runs.erase(it);
+			} else if (it->first < first) {
+				it->values.resize(first - it->first);
+				++it;
+			} else {
+				it->values.erase(
+					it->values.begin(), it->values.begin() + (last - it->first));
+				it->first = last;
+				++it;
+			}
+		}
+	}
+
+	// drops count LEDs at offset and moves subsequent runs down accordingly
+	void remove(led_i_t offset, size_t count) {
+		erase(offset, count);
+		for (auto &run : _runs) {
+			if (run.first >= offset) run.first -= (led_i_t)count;
+		}
+	}
+
+	// applies the overlay to count LEDs starting at first
+	void apply(led_t *leds, led_i_t first, size_t count) {
+		const led_i_t last = first + (led_i_t)count;
+		for (auto it = reaching(first + 1); it != _runs.end() && it->first < last;
+				 ++it) {
+			const led_i_t b    = std::max(first, it->first);
+			const led_i_t e    = std::min(last, it->end());
+			const void *  rgba = it->values.data() + (b - it->first);
+			led_overlay(leds + (b - first), (const float *)rgba, e - b);
+		}
+	}
+
+	// decoding of packed 8-bit pixels, hex colours of 8, 6, 4 or 3 digits
+	// (rgba, rgb and their 4-bit forms) and base64 payloads
+	static leda_t FromRGBA8(const uint8_t *p) {
+		const float a = p[3] * (1.0f / 255.f);
+		return {
+			{p[0] * (1.0f / 255.f) * a,
+			 p[1] * (1.0f / 255.f) * a,
+			 p[2] * (1.0f / 255.f) * a},
+			1 - a};
+	}
+	static leda_t FromRGB8(const uint8_t *p) {
+		return {
+			{p[0] * (1.0f / 255.f), p[1] * (1.0f / 255.f), p[2] * (1.0f / 255.f)},
+			0};
+	}
+
+	static bool ParseHex(const std::string &raw, leda_t &v) {
+		uint32_t rgba8 = std::strtoull(raw.c_str(), nullptr, 16);
+		if (raw.size() == 8) {
+			const float a = fclamp(((rgba8)&0xff) * (1.0f / 255.f));
+			v.r           = ((rgba8 >> 24) & 0xff) * (1.0f / 255.f) * a;
+			v.g           = ((rgba8 >> 16) & 0xff) * (1.0f / 255.f) * a;
+			v.b           = ((rgba8 >> 8) & 0xff) * (1.0f / 255.f) * a;
+			v.a           = 1.0 - a;
+		} else if (raw.size() == 6) {
+			v.r = ((rgba8 >> 16) & 0xff) * (1.0f / 255.f);
+			v.g = ((rgba8 >> 8) & 0xff) * (1.0f / 255.f);
+			v.b = ((rgba8 >> 0) & 0xff) * (1.0f / 255.f);
+			v.a = 0;
+		} else if (raw.size() == 4) {
+			const float a = fclamp(((rgba8)&0xf) * (1.0f / 15.f));
+			v.r           = ((rgba8 >> 12) & 0xf) * (1.0f / 15.f) * a;
+			v.g           = ((rgba8 >> 8) & 0xf) * (1.0f / 15.f) * a;
+			v.b           = ((rgba8 >> 4) & 0xf) * (1.0f / 15.f) * a;
+			v.a           = 1 - a;
+		} else if (raw.size() == 3) {
+			v.r = ((rgba8 >> 8) & 0xf) * (1.0f / 15.f);
+			v.g = ((rgba8 >> 4) & 0xf) * (1.0f / 15.f);
+			v.b = ((rgba8 >> 0) & 0xf) * (1.0f / 15.f);
+			v.a = 0;
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	static bool
+	DecodeBase64(const std::string &text, std::vector<uint8_t> &out) {
+		static int8_t table[256];
+		if (!table['B']) {
+			std::fill(std::begin(table), std::end(table), -1);
+			const char *alphabet =
+				"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			for (int i = 0; i < 64; i++) table[(uint8_t)alphabet[i]] = i;
+		}
+
+		out.clear();
+		out.reserve(text.size() / 4 * 3);
+		uint32_t acc  = 0;
+		int      bits = 0;
+		for (char c : text) {
+			if (c == '=') break;
+			const int8_t v = table[(uint8_t)c];
+			if (v < 0) return false;
+			acc = (acc << 6) | v;
+			bits += 6;
+			if (bits >= 8) {
+				bits -= 8;
+				out.push_back((acc >> bits) & 0xff);
+			}
+		}
+		return true;
+	}
+};
+
+#endif
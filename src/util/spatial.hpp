@@ -0,0 +1,336 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTIL_SPATIAL_HPP
+#define UTIL_SPATIAL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// Uniform grid over a static point set. Points are bucketed into cubic cells
+// and stored in CSR layout (per-cell offsets into a point list sorted by
+// cell), so queries only visit the cells overlapping their region and test
+// individual points only in cells straddling its boundary.
+class SpatialGrid {
+public:
+	using index_t = uint32_t;
+
+	struct Point {
+		float   p[3];
+		index_t index;
+	};
+
+protected:
+	float                 _origin[3] = {0, 0, 0};
+	float                 _cell      = 1;
+	float                 _cellInv   = 1;
+	long                  _dim[3]    = {0, 0, 0};
+	std::vector<uint32_t> _cellStart;
+	std::vector<Point>    _points;
+
+	long cellCoord(float v, int axis) const {
+		const float f = (v - _origin[axis]) * _cellInv;
+		if (!(f > 0)) return 0;
+		if (f >= _dim[axis]) return _dim[axis] - 1;
+		return (long)f;
+	}
+	size_t cellIndex(long x, long y, long z) const {
+		return ((size_t)z * _dim[1] + y) * _dim[0] + x;
+	}
+
+	static float dot(const float *a, const float *b) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	// calls classify(lo, hi) for every cell overlapping [qlo, qhi], returning
+	// <0 if the cell lies outside the region, >0 if inside and 0 if it
+	// straddles the boundary, in which case contains(p) decides per point.
+	template <typename Classify, typename Contains>
+	void query(
+		const float           qlo[3],
+		const float           qhi[3],
+		Classify              classify,
+		Contains              contains,
+		std::vector<index_t> &out) const {
+		if (_points.empty()) return;
+		long c0[3], c1[3];
+		for (int a = 0; a < 3; a++) {
+			if (qhi[a] < _origin[a] || qlo[a] > _origin[a] + _dim[a] * _cell) {
+				return;
+			}
+			c0[a] = cellCoord(qlo[a], a);
+			c1[a] = cellCoord(qhi[a], a);
+		}
+		for (long z = c0[2]; z <= c1[2]; z++) {
+			for (long y = c0[1]; y <= c1[1]; y++) {
+				for (long x = c0[0]; x <= c1[0]; x++) {
+					const size_t cell = cellIndex(x, y, z);
+					const auto   b = _cellStart[cell], e = _cellStart[cell + 1];
+					if (b == e) continue;
+					const float lo[3] = {
+						_origin[0] + x * _cell,
+						_origin[1] + y * _cell,
+						_origin[2] + z * _cell};
+					const float hi[3] = {lo[0] + _cell, lo[1] + _cell, lo[2] + _cell};
+					int         c     = classify(lo, hi);
+					if (c < 0) continue;
+					for (auto i = b; i < e; i++) {
+						if (c > 0 || contains(_points[i].p)) {
+							out.push_back(_points[i].index);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// classifies a cell against the plane band lo <= dot(p, n) <= hi
+	static int classifyBand(
+		const float *lo,
+		const float *hi,
+		const float *n,
+		float        dmin,
+		float        dmax) {
+		float pmin = 0, pmax = 0;
+		for (int a = 0; a < 3; a++) {
+			pmin += n[a] * (n[a] < 0 ? hi[a] : lo[a]);
+			pmax += n[a] * (n[a] < 0 ? lo[a] : hi[a]);
+		}
+		if (pmax < dmin || pmin > dmax) return -1;
+		if (pmin >= dmin && pmax <= dmax) return 1;
+		return 0;
+	}
+
+public:
+	size_t size() const { return _points.size(); }
+	bool   empty() const { return _points.empty(); }
+
+	// builds the grid over n points, point i being located at
+	// xyz[i * stride + 0..2]
+	void build(const float *xyz, size_t n, size_t stride) {
+		_points.clear();
+		_cellStart.clear();
+		if (n < 1) return;
+
+		float lo[3] = {xyz[0], xyz[1], xyz[2]};
+		float hi[3] = {xyz[0], xyz[1], xyz[2]};
+		for (size_t i = 1; i < n; i++) {
+			for (int a = 0; a < 3; a++) {
+				lo[a] = std::min(lo[a], xyz[i * stride + a]);
+				hi[a] = std::max(hi[a], xyz[i * stride + a]);
+			}
+		}
+
+		// aim for a few points per cell, bounding the cell count to 4n even for
+		// degenerate (flat or linear) layouts
+		float extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+		if (!(extent > 0)) extent = 1;
+		_cell = extent / std::max(1.0f, std::cbrt(n / 2.0f));
+		for (;;) {
+			size_t cells = 1;
+			for (int a = 0; a < 3; a++) {
+				_dim[a] = (long)std::floor((hi[a] - lo[a]) / _cell) + 1;
+				cells *= _dim[a];
+			}
+			if (cells <= 4 * n + 8) break;
+			_cell *= 1.25f;
+		}
+		_cellInv = 1.0f / _cell;
+		for (int a = 0; a < 3; a++) _origin[a] = lo[a];
+
+		// counting sort into CSR layout
+		std::vector<uint32_t> cellOf(n);
+		_cellStart.assign((size_t)_dim[0] * _dim[1] * _dim[2] + 1, 0);
+		for (size_t i = 0; i < n; i++) {
+			const float *p = xyz + i * stride;
+			cellOf[i]      = cellIndex(
+				cellCoord(p[0], 0), cellCoord(p[1], 1), cellCoord(p[2], 2));
+			_cellStart[cellOf[i] + 1]++;
+		}
+		for (size_t c = 1; c < _cellStart.size(); c++) {
+			_cellStart[c] += _cellStart[c - 1];
+		}
+		_points.resize(n);
+		std::vector<uint32_t> fill(_cellStart.begin(), _cellStart.end() - 1);
+		for (size_t i = 0; i < n; i++) {
+			const float *p = xyz + i * stride;
+			_points[fill[cellOf[i]]++] = {{p[0], p[1], p[2]}, (index_t)i};
+		}
+	}
+
+	void clear() {
+		_points.clear();
+		_cellStart.clear();
+	}
+
+	// points within the axis-aligned box center +- extent (inclusive)
+	void box(
+		const float *center, const float *extent, std::vector<index_t> &out) const {
+		const float qlo[3] = {
+			center[0] - extent[0], center[1] - extent[1], center[2] - extent[2]};
+		const float qhi[3] = {
+			center[0] + extent[0], center[1] + extent[1], center[2] + extent[2]};
+		query(
+			qlo,
+			qhi,
+			[&](const float *lo, const float *hi) {
+				for (int a = 0; a < 3; a++) {
+					if (lo[a] < qlo[a] || hi[a] > qhi[a]) return 0;
+				}
+				return 1;
+			},
+			[&](const float *p) {
+				for (int a = 0; a < 3; a++) {
+					if (std::fabs(p[a] - center[a]) > extent[a]) return false;
+				}
+				return true;
+			},
+			out);
+	}
+
+	// points within radius of center
+	void
+	sphere(const float *center, float radius, std::vector<index_t> &out) const {
+		const float qlo[3] = {
+			center[0] - radius, center[1] - radius, center[2] - radius};
+		const float qhi[3] = {
+			center[0] + radius, center[1] + radius, center[2] + radius};
+		const float r2 = radius * radius;
+		query(
+			qlo,
+			qhi,
+			[&](const float *lo, const float *hi) {
+				float dmin = 0, dmax = 0;
+				for (int a = 0; a < 3; a++) {
+					float d0 = lo[a] - center[a], d1 = center[a] - hi[a];
+					float dn = std::max({d0, d1, 0.0f});
+					float df = std::max(std::fabs(d0), std::fabs(d1));
+					dmin += dn * dn;
+					dmax += df * df;
+				}
+				if (dmin > r2) return -1;
+				return dmax <= r2 ? 1 : 0;
+			},
+			[&](const float *p) {
+				float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+				return dot(d, d) <= r2;
+			},
+			out);
+	}
+
+	// points p with dmin <= dot(p, normal) <= dmax
+	void band(
+		const float *         normal,
+		float                 dmin,
+		float                 dmax,
+		std::vector<index_t> &out) const {
+		const float qlo[3] = {
+			-std::numeric_limits<float>::infinity(),
+			-std::numeric_limits<float>::infinity(),
+			-std::numeric_limits<float>::infinity()};
+		const float qhi[3] = {
+			std::numeric_limits<float>::infinity(),
+			std::numeric_limits<float>::infinity(),
+			std::numeric_limits<float>::infinity()};
+		query(
+			qlo,
+			qhi,
+			[&](const float *lo, const float *hi) {
+				return classifyBand(lo, hi, normal, dmin, dmax);
+			},
+			[&](const float *p) {
+				float d = dot(p, normal);
+				return d >= dmin && d <= dmax;
+			},
+			out);
+	}
+
+	// up to count points closest to center, ordered by distance
+	void
+	nearest(const float *center, size_t count, std::vector<index_t> &out) const {
+		if (_points.empty() || count < 1) return;
+
+		using entry_t = std::pair<float, index_t>;
+		std::priority_queue<entry_t> heap;
+
+		long c[3];
+		for (int a = 0; a < 3; a++) c[a] = cellCoord(center[a], a);
+		const long rMax = std::max(
+			{c[0],
+			 _dim[0] - 1 - c[0],
+			 c[1],
+			 _dim[1] - 1 - c[1],
+			 c[2],
+			 _dim[2] - 1 - c[2]});
+
+		auto visitCell = [&](long x, long y, long z) {
+			if (x < 0 || y < 0 || z < 0) return;
+			if (x >= _dim[0] || y >= _dim[1] || z >= _dim[2]) return;
+			const size_t cell = cellIndex(x, y, z);
+			for (auto i = _cellStart[cell]; i < _cellStart[cell + 1]; i++) {
+				const float *p = _points[i].p;
+				float d[3]     = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+				float d2       = dot(d, d);
+				if (heap.size() < count) {
+					heap.emplace(d2, _points[i].index);
+				} else if (d2 < heap.top().first) {
+					heap.pop();
+					heap.emplace(d2, _points[i].index);
+				}
+			}
+		};
+
+		for (long r = 0; r <= rMax; r++) {
+			// visit the shell of cells at chebyshev distance r
+			for (long dz = -r; dz <= r; dz++) {
+				for (long dy = -r; dy <= r; dy++) {
+					const bool face = (dz == -r || dz == r || dy == -r || dy == r);
+					for (long dx = -r; dx <= r; dx += face ? 1 : 2 * r) {
+						visitCell(c[0] + dx, c[1] + dy, c[2] + dz);
+						if (r == 0) break;
+					}
+				}
+			}
+
+			// distance from center to the nearest cell not yet visited
+			float bound = std::numeric_limits<float>::infinity();
+			for (int a = 0; a < 3; a++) {
+				const float lo = _origin[a] + (c[a] - r) * _cell;
+				const float hi = _origin[a] + (c[a] + r + 1) * _cell;
+				if (c[a] - r > 0) bound = std::min(bound, center[a] - lo);
+				if (c[a] + r + 1 < _dim[a]) bound = std::min(bound, hi - center[a]);
+			}
+			bound = std::max(bound, 0.0f);
+			if (heap.size() >= count && heap.top().first <= bound * bound) break;
+		}
+
+		const size_t n0 = out.size();
+		out.resize(n0 + heap.size());
+		for (size_t i = out.size(); i > n0; i--) {
+			out[i - 1] = heap.top().second;
+			heap.pop();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,94 @@
+/* Copyright 2022 Peter Wagener <mail@peterwagener.net>
+
+This file is part of Freyr2.
+
+Freyr2 is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Freyr2 is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+Freyr2. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef UTIL_UART_HPP
+#define UTIL_UART_HPP
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Encodes 8N1 UART frames into a bitstream, MSB first. Frames are looked up
+// as 10-bit patterns and collected in a bit accumulator that is written out
+// 32 bits at a time. Complete bytes still pending are written by flush and on
+// destruction, a trailing partial byte only by flush.
+struct UARTEncoder {
+	uint8_t *&ptr;
+	uint64_t  acc  = 0;
+	int       bits = 0;
+
+	// frame bits in transmission order: start bit, data LSB first, stop bit
+	static constexpr std::array<uint16_t, 256> Frames = [] {
+		std::array<uint16_t, 256> res{};
+		for (int data = 0; data < 256; data++) {
+			uint16_t frame = 0;
+			for (int i = 0; i < 8; i++) frame = (frame << 1) | ((data >> i) & 1);
+			res[data] = (frame << 1) | 1;
+		}
+		return res;
+	}();
+
+	static size_t EncodedSize(size_t frames) {
+		size_t res = frames * 10;
+		return res / 8 + ((res % 8) ? 1 : 0);
+	}
+
+	UARTEncoder(uint8_t *&ptr) : ptr(ptr) {}
+	~UARTEncoder() { drain(); }
+
+	inline void emitWord() {
+		if (bits < 32) return;
+		bits -= 32;
+		const uint32_t word = htonl((uint32_t)(acc >> bits));
+		memcpy(ptr, &word, 4);
+		ptr += 4;
+	}
+
+	// writes all complete bytes
+	inline void drain() {
+		for (; bits >= 8; bits -= 8) *ptr++ = (acc >> (bits - 8)) & 0xff;
+	}
+
+	inline void flush() {
+		if (bits % 8) {
+			const int pad = 8 - bits % 8;
+			acc           = (acc << pad) | ((1u << pad) - 1);
+			bits += pad;
+		}
+		drain();
+	}
+	inline void addFrame(uint8_t data) {
+		acc = (acc << 10) | Frames[data];
+		bits += 10;
+		emitWord();
+	}
+
+	inline void addIdle(size_t duration) {
+		while (duration > 0) {
+			const int n = std::min<size_t>(duration, 32);
+			acc         = (acc << n) | ((uint64_t(1) << n) - 1);
+			bits += n;
+			duration -= n;
+			emitWord();
+		}
+	}
+};
+
+#endif
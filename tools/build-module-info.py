@@ -48,12 +48,15 @@ groups = (
     ("stmod_egress_", "Egress", "EgressModules", "EgressModule",
      (("init", "egressno_t egressno, const char *argstr, void **puserdata"),
       ("describe", ""), ("deinit", "void *userdata"),
-      ("flush", "led_i_t firstLED, led_i_t count, void *userdata"))),
+      ("flush", "led_i_t firstLED, led_i_t count, void *userdata"),
+      ("status", "void *userdata, char *buf, size_t size"))),
     ("stmod_blend_", "Blend", "BlendModules", "BlendModule",
      (("init", "const char *argstr, void **puserdata"), ("describe", ""),
       ("deinit", "void *userdata"),
+      ("prepare",
+       "const led_i_t *ledv, size_t ledn, float * geometry, void * userdata"),
       ("mix",
-       "const led_i_t *ledv, size_t ledn, led_t * accum, const led_t * op2, frame_time_t dt, frame_time_t t, void * userdata"
+       "const led_i_t *ledv, size_t ledn, led_t * accum, const led_t * op2, const float * geometry, frame_time_t dt, frame_time_t t, void * userdata"
        ))),
 )
 
@@ -94,7 +97,7 @@ if True:  # install symbols
                     header += f"""extern "C" {{ extern void {prefix_mod}_{id}({arglist});}}\n"""
                     symdef += f"""  BaseModule::DefineSymbol("{id_mod}","{id}",(void*){prefix_mod}_{id});\n"""
 
-            for id in ("SingletonInstance", ):
+            for id in ("SingletonInstance", "Flags", "Rate"):
                 if id in syms_mod:
                     header += f"""extern "C" {{ extern int {prefix_mod}_{id}; }}\n"""
                     symdef += f"""  BaseModule::DefineSymbol("{id_mod}","{id}",(void*)&{prefix_mod}_{id});\n"""
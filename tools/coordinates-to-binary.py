@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Converts the coordinates_set commands of a configuration file into a binary
+# coordinates file to be read by coordinates_load (see
+# src/modules/coordinates_api.h for the format).
+import argparse
+import pathlib
+import shlex
+import struct
+import sys
+
+MAGIC = 0x31435246
+COMPONENTS = 6
+
+parser = argparse.ArgumentParser(
+    description="convert coordinates_set commands into a binary file")
+parser.add_argument("config", type=pathlib.Path, help="input configuration")
+parser.add_argument("output", type=pathlib.Path, help="binary file to write")
+parser.add_argument(
+    "--rewrite",
+    type=pathlib.Path,
+    default=None,
+    help="also write a copy of the configuration using coordinates_load")
+args = parser.parse_args()
+
+egress_offsets = {}
+led_count = 0
+coords = {}
+lines_out = []
+load_emitted = False
+
+with open(args.config) as f:
+    for ln in f:
+        try:
+            tokens = shlex.split(ln, comments=True)
+        except ValueError:
+            tokens = []
+        if len(tokens) >= 4 and tokens[0] == "egress_init":
+            egress_offsets[tokens[2]] = led_count
+            led_count += int(tokens[3])
+        elif len(tokens) >= 3 and tokens[0] == "coordinates_set":
+            egress, offset = tokens[1], int(tokens[2])
+            if egress:
+                if egress not in egress_offsets:
+                    sys.exit(f"coordinates_set for unknown egress '{egress}'")
+                offset += egress_offsets[egress]
+            values = [float(v) for v in tokens[3:]]
+            for i in range(len(values) // COMPONENTS):
+                coords[offset + i] = values[i * COMPONENTS:(i + 1) *
+                                            COMPONENTS]
+            if not load_emitted:
+                lines_out.append(f"coordinates_load {args.output}\n")
+                load_emitted = True
+            continue
+        lines_out.append(ln)
+
+count = max(led_count, max(coords.keys(), default=-1) + 1)
+with open(args.output, "wb") as f:
+    f.write(struct.pack("<4I", MAGIC, count, COMPONENTS, 0))
+    zero = [0.0] * COMPONENTS
+    for i in range(count):
+        f.write(struct.pack(f"<{COMPONENTS}f", *coords.get(i, zero)))
+
+print(f"wrote {len(coords)} of {count} LEDs to {args.output}")
+
+if args.rewrite is not None:
+    with open(args.rewrite, "w") as f:
+        f.writelines(lines_out)